@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <malloc.h>
+#include <new>
+#include <vector>
+#include "AllocationCounter.h"
+
+// Allocator for containers of types that want more alignment than the heap
+// gives, Vector4 and Matrix4 are 16 byte aligned but new on x86 only promises
+// 8 bytes
+template <typename T>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	AlignedAllocator()
+	{ }
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U> &)
+	{ }
+
+	T * allocate(std::size_t count)
+	{
+		AllocationCounter::Add();
+
+		void * memory = _aligned_malloc(count * sizeof(T), Alignment);
+
+		if (! memory)
+			throw std::bad_alloc();
+
+		return static_cast<T*>(memory);
+	}
+
+	void deallocate(T * pointer, std::size_t)
+	{
+		_aligned_free(pointer);
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U> &) const
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U> &) const
+	{
+		return false;
+	}
+
+private:
+	static const std::size_t Alignment = alignof(T) > 16 ? alignof(T) : 16;
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
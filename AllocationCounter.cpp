@@ -0,0 +1,64 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+namespace
+{
+#ifdef _DEBUG
+	std::atomic<std::size_t> g_count(0);
+	thread_local unsigned t_allowed = 0;
+#endif
+}
+
+std::size_t AllocationCounter::GetCount()
+{
+#ifdef _DEBUG
+	return g_count.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+
+void AllocationCounter::Add()
+{
+#ifdef _DEBUG
+	if (t_allowed == 0)
+		g_count.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+AllocationCounter::Allow::Allow()
+{
+#ifdef _DEBUG
+	++t_allowed;
+#endif
+}
+
+AllocationCounter::Allow::~Allow()
+{
+#ifdef _DEBUG
+	--t_allowed;
+#endif
+}
+
+#ifdef _DEBUG
+
+// The array and nothrow forms all end up here
+
+void * operator new(std::size_t size)
+{
+	AllocationCounter::Add();
+
+	if (void * memory = std::malloc(size != 0 ? size : 1))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void * pointer) noexcept
+{
+	std::free(pointer);
+}
+
+#endif
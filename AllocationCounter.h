@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts heap allocations in debug builds, from the global operator new and
+// from AlignedAllocator. Release builds count nothing and GetCount is
+// always 0.
+class AllocationCounter
+{
+public:
+	static std::size_t GetCount();
+
+	static void Add();
+
+	// Allocations on this thread while one of these is alive aren't counted.
+	// For work that is meant to allocate when it happens but is rare, like
+	// compiling a shader or growing the frame arena.
+	class Allow
+	{
+	public:
+		Allow();
+		~Allow();
+
+		Allow(const Allow &) = delete;
+		Allow & operator=(const Allow &) = delete;
+	};
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Read-only pointer and length pair over contiguous elements that belong to
+// something else, e.g. a std::vector or a mapped file. Named like the
+// standard containers so that it can stand in for a const std::vector &.
+template <typename T>
+class ArrayView
+{
+public:
+	ArrayView()
+		: m_data(nullptr)
+		, m_size(0)
+	{ }
+
+	ArrayView(const T * data, std::size_t size)
+		: m_data(data)
+		, m_size(size)
+	{ }
+
+	ArrayView(const std::vector<T> & vector)
+		: m_data(vector.data())
+		, m_size(vector.size())
+	{ }
+
+	const T * data() const { return m_data; }
+	std::size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	const T * begin() const { return m_data; }
+	const T * end() const { return m_data + m_size; }
+
+	const T & operator[](std::size_t index) const
+	{
+		assert(index < m_size);
+		return m_data[index];
+	}
+
+private:
+	const T * m_data;
+	std::size_t m_size;
+};
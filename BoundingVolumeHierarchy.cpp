@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include "BoundingVolumeHierarchy.h"
+
+namespace
+{
+	const uint32_t MaxLeafObjects = 4;
+
+	// Refitting lets the boxes grow as objects move apart, rebuild once the
+	// total area has grown by this much
+	const Real RebuildRatio = 2.0f;
+
+	geometry::BoundingBox Union(const geometry::BoundingBox & a, const geometry::BoundingBox & b)
+	{
+		return {
+			{ std::min(a.m_min.x, b.m_min.x), std::min(a.m_min.y, b.m_min.y), std::min(a.m_min.z, b.m_min.z) },
+			{ std::max(a.m_max.x, b.m_max.x), std::max(a.m_max.y, b.m_max.y), std::max(a.m_max.z, b.m_max.z) },
+		};
+	}
+
+	Real Area(const geometry::BoundingBox & box)
+	{
+		const Vector3 size = box.m_max - box.m_min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	Vector3 Centre(const geometry::BoundingBox & box)
+	{
+		return (box.m_min + box.m_max) * 0.5f;
+	}
+
+	Real Axis(const Vector3 & v, unsigned axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	// Slab test, returns the distance where the ray enters the box
+	bool IntersectRay(const geometry::BoundingBox & box, const Vector3 & origin,
+		const Vector3 & inverseDirection, Real limit, Real & distance)
+	{
+		Real tmin = 0.0f;
+		Real tmax = limit;
+
+		for (unsigned axis = 0; axis < 3; ++axis)
+		{
+			Real t1 = (Axis(box.m_min, axis) - Axis(origin, axis)) * Axis(inverseDirection, axis);
+			Real t2 = (Axis(box.m_max, axis) - Axis(origin, axis)) * Axis(inverseDirection, axis);
+
+			if (t1 > t2)
+				std::swap(t1, t2);
+
+			tmin = std::max(tmin, t1);
+			tmax = std::min(tmax, t2);
+
+			if (tmin > tmax)
+				return false;
+		}
+
+		distance = tmin;
+		return true;
+	}
+}
+
+void BoundingVolumeHierarchy::Build(const std::vector<geometry::Object*> & objects)
+{
+	m_objects = objects;
+
+	Rebuild();
+}
+
+void BoundingVolumeHierarchy::Rebuild()
+{
+	m_nodes.clear();
+
+	if (m_objects.empty())
+	{
+		m_builtSurfaceArea = 0.0f;
+		return;
+	}
+
+	m_nodes.reserve(2 * m_objects.size());
+	m_nodes.resize(1);
+
+	BuildNode(0, 0, static_cast<uint32_t>(m_objects.size()));
+
+	m_builtSurfaceArea = SurfaceArea();
+}
+
+void BoundingVolumeHierarchy::BuildNode(uint32_t index, uint32_t first, uint32_t count)
+{
+	geometry::BoundingBox box = m_objects[first]->GetWorldBoundingBox();
+	geometry::BoundingBox centres = { Centre(box), Centre(box) };
+
+	for (uint32_t i = first + 1; i < first + count; ++i)
+	{
+		const geometry::BoundingBox & objectBox = m_objects[i]->GetWorldBoundingBox();
+		const Vector3 centre = Centre(objectBox);
+
+		box = Union(box, objectBox);
+		centres = Union(centres, { centre, centre });
+	}
+
+	m_nodes[index] = { box, first, count, 0 };
+
+	if (count <= MaxLeafObjects)
+		return;
+
+	// median split along the axis where the centres are most spread out
+	const Vector3 extent = centres.m_max - centres.m_min;
+
+	unsigned axis = 0;
+
+	if (extent.y > Axis(extent, axis))
+		axis = 1;
+
+	if (extent.z > Axis(extent, axis))
+		axis = 2;
+
+	const uint32_t half = count / 2;
+
+	std::nth_element(
+		m_objects.begin() + first,
+		m_objects.begin() + first + half,
+		m_objects.begin() + first + count,
+		[axis](const geometry::Object * lhs, const geometry::Object * rhs)
+		{
+			return Axis(Centre(lhs->GetWorldBoundingBox()), axis)
+				< Axis(Centre(rhs->GetWorldBoundingBox()), axis);
+		});
+
+	// children are allocated together and always after their parent, which
+	// is what lets Refit work backwards through the array
+	const uint32_t child = static_cast<uint32_t>(m_nodes.size());
+
+	m_nodes.resize(m_nodes.size() + 2);
+	m_nodes[index].m_child = child;
+
+	BuildNode(child, first, half);
+	BuildNode(child + 1, first + half, count - half);
+}
+
+void BoundingVolumeHierarchy::Update()
+{
+	if (m_nodes.empty())
+		return;
+
+	Refit();
+
+	// the objects and nodes are rebuilt where they are, the arrays are
+	// already the right size so moving objects never allocate
+	if (SurfaceArea() > m_builtSurfaceArea * RebuildRatio)
+		Rebuild();
+}
+
+void BoundingVolumeHierarchy::Refit()
+{
+	for (std::size_t i = m_nodes.size(); i-- > 0; )
+	{
+		Node & node = m_nodes[i];
+
+		if (node.m_child != 0)
+		{
+			node.m_box = Union(m_nodes[node.m_child].m_box, m_nodes[node.m_child + 1].m_box);
+			continue;
+		}
+
+		node.m_box = m_objects[node.m_first]->GetWorldBoundingBox();
+
+		for (uint32_t j = node.m_first + 1; j < node.m_first + node.m_count; ++j)
+			node.m_box = Union(node.m_box, m_objects[j]->GetWorldBoundingBox());
+	}
+}
+
+Real BoundingVolumeHierarchy::SurfaceArea() const
+{
+	Real area = 0.0f;
+
+	for (auto && node : m_nodes)
+		area += Area(node.m_box);
+
+	return area;
+}
+
+void BoundingVolumeHierarchy::Cull(const Frustum & frustum, std::vector<geometry::Object*> & visible) const
+{
+	if (m_nodes.empty())
+		return;
+
+	uint32_t stack[64];
+	uint32_t depth = 0;
+
+	stack[depth++] = 0;
+
+	while (depth > 0)
+	{
+		const Node & node = m_nodes[stack[--depth]];
+
+		const Containment containment = frustum.Classify(node.m_box);
+
+		if (containment == Containment::Outside)
+			continue;
+
+		if (containment == Containment::Inside)
+		{
+			// every object below here is visible, no more tests needed
+			visible.insert(visible.end(),
+				m_objects.begin() + node.m_first,
+				m_objects.begin() + node.m_first + node.m_count);
+			continue;
+		}
+
+		if (node.m_child != 0)
+		{
+			assert(depth + 2 <= 64);
+
+			stack[depth++] = node.m_child + 1;
+			stack[depth++] = node.m_child;
+			continue;
+		}
+
+		for (uint32_t i = node.m_first; i < node.m_first + node.m_count; ++i)
+		{
+			geometry::Object * object = m_objects[i];
+
+			if (frustum.Intersects(object->GetWorldBoundingSphere()) &&
+				frustum.Intersects(object->GetWorldBoundingBox()))
+			{
+				visible.push_back(object);
+			}
+		}
+	}
+}
+
+geometry::Object * BoundingVolumeHierarchy::Pick(const Vector3 & origin, const Vector3 & direction) const
+{
+	if (m_nodes.empty())
+		return nullptr;
+
+	// 1/0 gives infinity which the slab test handles
+	const Vector3 inverseDirection = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+
+	geometry::Object * nearest = nullptr;
+	Real nearestDistance = std::numeric_limits<Real>::max();
+
+	uint32_t stack[64];
+	uint32_t depth = 0;
+
+	stack[depth++] = 0;
+
+	while (depth > 0)
+	{
+		const Node & node = m_nodes[stack[--depth]];
+
+		Real distance;
+
+		if (!IntersectRay(node.m_box, origin, inverseDirection, nearestDistance, distance))
+			continue;
+
+		if (node.m_child != 0)
+		{
+			assert(depth + 2 <= 64);
+
+			stack[depth++] = node.m_child + 1;
+			stack[depth++] = node.m_child;
+			continue;
+		}
+
+		for (uint32_t i = node.m_first; i < node.m_first + node.m_count; ++i)
+		{
+			geometry::Object * object = m_objects[i];
+
+			if (!IntersectRay(object->GetWorldBoundingBox(), origin, inverseDirection, nearestDistance, distance))
+				continue;
+
+			if (object->Intersect(origin, direction, distance) && distance < nearestDistance)
+			{
+				nearest = object;
+				nearestDistance = distance;
+			}
+		}
+	}
+
+	return nearest;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Frustum.h"
+#include "Geometry.h"
+#include "Types.h"
+#include "Vector.h"
+
+// Binary tree over the world bounds of a set of objects. Objects are stored
+// in tree order so that every node covers a contiguous range of them.
+class BoundingVolumeHierarchy
+{
+public:
+	void Build(const std::vector<geometry::Object*> & objects);
+
+	// Recomputes the node bounds from the objects' current world bounds
+	// without changing the tree's shape. Once the objects have moved far
+	// enough that the boxes overlap badly the tree is rebuilt instead.
+	void Update();
+
+	void Cull(const Frustum & frustum, std::vector<geometry::Object*> & visible) const;
+
+	// Nearest object hit by a world space ray or nullptr
+	geometry::Object * Pick(const Vector3 & origin, const Vector3 & direction) const;
+
+	std::size_t GetNumObjects() const { return m_objects.size(); }
+
+private:
+	struct Node
+	{
+		geometry::BoundingBox m_box;
+		uint32_t m_first;
+		uint32_t m_count;
+
+		// the children are always next to each other so only the first is
+		// stored, the root can't be a child so 0 marks a leaf
+		uint32_t m_child;
+	};
+
+	void Rebuild();
+	void BuildNode(uint32_t index, uint32_t first, uint32_t count);
+	void Refit();
+	Real SurfaceArea() const;
+
+private:
+	std::vector<geometry::Object*> m_objects;
+	std::vector<Node> m_nodes;
+	Real m_builtSurfaceArea = 0.0f;
+};
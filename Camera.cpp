@@ -13,9 +13,11 @@ Matrix4 Camera::GetTransform() const
 
 void Camera::Move(const Vector3 & relative)
 {
-	m_position += Matrix4::RotationAboutY(Units::Radians, m_yaw)
-		* Matrix4::RotationAboutX(Units::Radians, m_pitch)
-		* relative;
+	const Matrix4 rotation = Matrix4::RotationAboutY(Units::Radians, m_yaw)
+		* Matrix4::RotationAboutX(Units::Radians, m_pitch);
+
+	// a direction, so w = 0 and there's nothing to divide by afterwards
+	m_position += (rotation * Vector4(relative.x, relative.y, relative.z, 0.0)).XYZ();
 }
 
 void Camera::MouseMoved(int xdelta, int ydelta)
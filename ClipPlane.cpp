@@ -12,37 +12,33 @@ namespace
 		};
 	}
 
-	Vector4 LinearInterpolate(Vector4 start, Vector4 end, Real distance)
+	// aligned types can't be passed by value on x86
+	Vector4 LinearInterpolate(const Vector4 & start, const Vector4 & end, Real distance)
 	{
-		return{
-			start.x + (end.x - start.x) * distance,
-			start.y + (end.y - start.y) * distance,
-			start.z + (end.z - start.z) * distance,
-			start.w + (end.w - start.w) * distance,
-		};
+		return start + (end - start) * distance;
 	}
 }
 
-std::vector<VertexShaderOutput> ClipPlane::Clip(const std::vector<VertexShaderOutput> & points) const
+std::size_t ClipPlane::Clip(const VertexShaderOutput * points, std::size_t count, VertexShaderOutput * output) const
 {
-	std::vector<VertexShaderOutput> output;
-
-	const std::size_t size = points.size();
+	std::size_t written = 0;
 
-	if (size == 0)
-		return output;
+	if (count == 0)
+		return written;
 
-	const std::size_t limit = size - 1;
+	const std::size_t limit = count - 1;
 
 	for (std::size_t i = 0; i < limit; ++i)
-		ProcessEdge(output, points[i], points[i+1]);
+		ProcessEdge(output, written, points[i], points[i+1]);
+
+	ProcessEdge(output, written, points[limit], points[0]);
 
-	ProcessEdge(output, points[limit], points[0]);
+	assert(written <= count + 1);
 
-	return output;
+	return written;
 }
 
-void ClipPlane::ProcessEdge(std::vector<VertexShaderOutput> & output, const VertexShaderOutput & p1,
+void ClipPlane::ProcessEdge(VertexShaderOutput * output, std::size_t & written, const VertexShaderOutput & p1,
 	const VertexShaderOutput & p2) const
 {
 	if (Inside(p1.m_screen))
@@ -50,12 +46,12 @@ void ClipPlane::ProcessEdge(std::vector<VertexShaderOutput> & output, const Vert
 		// both inside
 		if (Inside(p2.m_screen))
 		{
-			output.push_back(p2);
+			output[written++] = p2;
 		}
 		// inside -> outside
 		else
 		{
-			output.push_back(Intersect(p1, p2));
+			output[written++] = Intersect(p1, p2);
 		}
 	}
 	else
@@ -63,8 +59,8 @@ void ClipPlane::ProcessEdge(std::vector<VertexShaderOutput> & output, const Vert
 		// outside -> inside
 		if (Inside(p2.m_screen))
 		{
-			output.push_back(Intersect(p1, p2));
-			output.push_back(p2);
+			output[written++] = Intersect(p1, p2);
+			output[written++] = p2;
 		}
 		// both outside
 		else
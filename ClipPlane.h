@@ -1,7 +1,7 @@
 #pragma once
 
 #include <cassert>
-#include <vector>
+#include <cstddef>
 
 #include "Point.h"
 
@@ -15,11 +15,14 @@ public:
 		, m_direction(direction)
 	{ }
 
-	std::vector<VertexShaderOutput> Clip(const std::vector<VertexShaderOutput> & points) const;
+	// Clipping a convex polygon adds at most one point so output needs room
+	// for count + 1. Returns how many points were written.
+	std::size_t Clip(const VertexShaderOutput * points, std::size_t count, VertexShaderOutput * output) const;
 
 private:
 	void ProcessEdge(
-		std::vector<VertexShaderOutput> & output,
+		VertexShaderOutput * output,
+		std::size_t & written,
 		const VertexShaderOutput & p1,
 		const VertexShaderOutput & p2) const;
 
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "AllocationCounter.h"
+#include "DamageTracker.h"
+#include "FrameBuffer.h"
+#include "SimdMath.h"
+
+namespace
+{
+	bool SameSettings(const DamageTracker::Settings & lhs, const DamageTracker::Settings & rhs)
+	{
+		if (lhs.m_mode != rhs.m_mode || lhs.m_cull != rhs.m_cull || lhs.m_drawNormals != rhs.m_drawNormals ||
+			lhs.m_width != rhs.m_width || lhs.m_height != rhs.m_height)
+			return false;
+
+		for (unsigned row = 0; row < 4; ++row)
+		{
+			for (unsigned column = 0; column < 4; ++column)
+			{
+				if (lhs.m_view(row, column) != rhs.m_view(row, column))
+					return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+DamageTracker::Region DamageTracker::Update(const Settings & settings, const Projection & projection,
+	const ArenaVector<geometry::Object*> & objects, const geometry::Object * picked)
+{
+	const Region whole = { 0, 0, settings.m_width, settings.m_height };
+
+	bool same = m_valid && SameSettings(m_settings, settings) && objects.size() == m_records.size();
+
+	for (std::size_t i = 0; i < objects.size() && same; ++i)
+		same = (m_records[i].m_object == objects[i]);
+
+	m_settings = settings;
+	m_viewProjection = projection.GetProjectionMatrix() * settings.m_view;
+	m_valid = true;
+
+	if (! same)
+	{
+		if (m_records.size() != objects.size())
+		{
+			// only when the scene changes
+			AllocationCounter::Allow allow;
+
+			m_records.resize(objects.size());
+		}
+
+		for (std::size_t i = 0; i < objects.size(); ++i)
+			m_records[i] = { objects[i], objects[i]->GetVersion(), objects[i]->GetWorldBoundingBox() };
+
+		m_picked = picked;
+
+		return whole;
+	}
+
+	// grows from nothing as boxes are added
+	Region region = { settings.m_width, settings.m_height, 0, 0 };
+
+	for (std::size_t i = 0; i < objects.size(); ++i)
+	{
+		Record & record = m_records[i];
+		const geometry::Object * object = objects[i];
+
+		// the outline goes from one object to the other
+		const bool outline = (object == picked) != (object == m_picked);
+
+		if (record.m_version == object->GetVersion() && ! outline)
+			continue;
+
+		AddBox(projection, record.m_box, region);
+
+		record.m_version = object->GetVersion();
+		record.m_box = object->GetWorldBoundingBox();
+
+		AddBox(projection, record.m_box, region);
+	}
+
+	m_picked = picked;
+
+	// normals stick out past the bounds
+	if (settings.m_drawNormals && ! region.IsEmpty())
+		return whole;
+
+	return region;
+}
+
+void DamageTracker::AddBox(const Projection & projection, const geometry::BoundingBox & box, Region & region) const
+{
+	std::array<Vector3, 8> points;
+	std::array<Vector4, 8> corners;
+
+	for (unsigned i = 0; i < 8; ++i)
+	{
+		points[i] = {
+			(i & 1) ? box.m_max.x : box.m_min.x,
+			(i & 2) ? box.m_max.y : box.m_min.y,
+			(i & 4) ? box.m_max.z : box.m_min.z,
+		};
+	}
+
+	simd::TransformPoints(m_viewProjection, points.data(), points.size(), corners.data());
+
+	const Real width = static_cast<Real>(m_settings.m_width);
+	const Real height = static_cast<Real>(m_settings.m_height);
+
+	Real left = width;
+	Real top = height;
+	Real right = 0.0f;
+	Real bottom = 0.0f;
+
+	for (auto && corner : corners)
+	{
+		// the box wraps around to the other side of the screen
+		if (corner.w <= 0.0f)
+		{
+			region = { 0, 0, m_settings.m_width, m_settings.m_height };
+			return;
+		}
+
+		const Real x = projection.ToScreenX(corner.x / corner.w);
+		const Real y = projection.ToScreenY(corner.y / corner.w);
+
+		left = std::min(left, x);
+		top = std::min(top, y);
+		right = std::max(right, x);
+		bottom = std::max(bottom, y);
+	}
+
+	// a pixel either side covers rounding, lines are drawn between
+	// truncated ends
+	left = std::max(0.0f, std::floor(left) - 1.0f);
+	top = std::max(0.0f, std::floor(top) - 1.0f);
+	right = std::min(width, std::ceil(right) + 2.0f);
+	bottom = std::min(height, std::ceil(bottom) + 2.0f);
+
+	if (left >= right || top >= bottom)
+		return;
+
+	const unsigned tile = FrameBuffer::kTileSize;
+
+	region.m_left = std::min(region.m_left, static_cast<unsigned>(left) / tile * tile);
+	region.m_top = std::min(region.m_top, static_cast<unsigned>(top) / tile * tile);
+	region.m_right = std::max(region.m_right, std::min(m_settings.m_width, (static_cast<unsigned>(right) + tile - 1) / tile * tile));
+	region.m_bottom = std::max(region.m_bottom, std::min(m_settings.m_height, (static_cast<unsigned>(bottom) + tile - 1) / tile * tile));
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "FrameArena.h"
+#include "Geometry.h"
+#include "Matrix.h"
+#include "Projection.h"
+#include "Rasteriser.h"
+
+// Works out how much of a frame has to be drawn again from what changed
+// since the last one. Anything that moves every pixel (the camera, the
+// render mode, the size drawn at) needs the whole frame, otherwise it's
+// where each object that changed was drawn and where it is now. Nothing
+// changing means the last frame can stay on the screen.
+//
+// Objects are compared by their version rather than their matrices so
+// shaders, colours and buffers count as well.
+class DamageTracker
+{
+public:
+	// What every pixel of the frame depends on
+	struct Settings
+	{
+		Matrix4 m_view;
+		RenderMode m_mode;
+		bool m_cull;
+		bool m_drawNormals;
+		unsigned m_width;
+		unsigned m_height;
+	};
+
+	// Columns left to right - 1 of rows top to bottom - 1, on tile
+	// boundaries unless it's the edge of the frame
+	struct Region
+	{
+		unsigned m_left;
+		unsigned m_top;
+		unsigned m_right;
+		unsigned m_bottom;
+
+		bool IsEmpty() const { return m_left >= m_right || m_top >= m_bottom; }
+	};
+
+	// Compares the frame about to be drawn with the last one and remembers
+	// it for the next. objects is the whole scene, not just what's visible,
+	// and picked is the object with its bounds drawn around it.
+	Region Update(const Settings & settings, const Projection & projection,
+		const ArenaVector<geometry::Object*> & objects, const geometry::Object * picked);
+
+	// The next frame is drawn whole
+	void Reset() { m_valid = false; }
+
+	bool IsWhole(const Region & region) const
+	{
+		return region.m_left == 0 && region.m_top == 0 &&
+			region.m_right == m_settings.m_width && region.m_bottom == m_settings.m_height;
+	}
+
+private:
+	struct Record
+	{
+		const geometry::Object * m_object;
+		uint32_t m_version;
+
+		// where it was last drawn, the camera hasn't moved since
+		geometry::BoundingBox m_box;
+	};
+
+	// The box on the screen grown out to whole tiles, everything when part
+	// of it is behind the camera
+	void AddBox(const Projection & projection, const geometry::BoundingBox & box, Region & region) const;
+
+private:
+	bool m_valid = false;
+	Settings m_settings;
+	Matrix4 m_viewProjection;
+
+	std::vector<Record> m_records;
+	const geometry::Object * m_picked = nullptr;
+};
@@ -21,14 +21,14 @@ FragmentShader::FragmentShader(ShadyObject * shader)
 	SetShader(shader);
 }
 
-bool FragmentShader::Execute(int x, int y, FrameBuffer * buffer, Colour & colour) const
+bool FragmentShader::Execute(int x, int y, FrameBuffer * buffer, const FrameBuffer::Pixel & pixel, Colour & colour) const
 {
 	InterpolatedValues interpolated = InterpolateForContext(x, y);
 
-	if (buffer->GetDepth(x, y) < interpolated.z)
+	if (buffer->GetDepth(pixel) < interpolated.z)
 		return false;
 
-	buffer->SetDepth(x, y, interpolated.z);
+	buffer->SetDepth(pixel, interpolated.z);
 
 	if (m_shader)
 	{
@@ -42,11 +42,11 @@ bool FragmentShader::Execute(int x, int y, FrameBuffer * buffer, Colour & colour
 
 		m_g_colour.Read(c);
 
-		colour = { c.x, c.y, c.z };
+		colour = { c.x * m_tint.r, c.y * m_tint.g, c.z * m_tint.b };
 		return true;
 	}
 
-	colour = Colour::White;
+	colour = m_tint;
 	return true;
 }
 
@@ -2,11 +2,10 @@
 
 #include <array>
 #include "Colour.h"
+#include "FrameBuffer.h"
 #include "ShadyObject.h"
 #include "VertexShader.h"
 
-class FrameBuffer;
-
 struct InterpolatedValues
 {
 	Vector3 position;
@@ -19,10 +18,15 @@ class FragmentShader
 public:
 	FragmentShader(ShadyObject * shader);
 
-	bool Execute(int x, int y, FrameBuffer * buffer, Colour & colour) const;
+	// The pixel is x, y located in the buffer, the rasteriser writes the
+	// colour to the same place
+	bool Execute(int x, int y, FrameBuffer * buffer, const FrameBuffer::Pixel & pixel, Colour & colour) const;
 
 	void SetLightPosition(const Vector3 & position);
 
+	// Multiplies whatever colour the shader outputs
+	void SetTint(const Colour & tint) { m_tint = tint; }
+
 	void SetTriangleContext(const std::array<VertexShaderOutput, 3> * triangle);
 
 	void SetShader(ShadyObject * shader);
@@ -35,6 +39,7 @@ private:
 	Real m_totalArea;
 
 	Vector3 m_lightPosition;
+	Colour m_tint = Colour::White;
 	ShadyObject *m_shader;
 
 	ShadyObject::GlobalWriter m_g_light0_position;
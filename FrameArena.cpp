@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <malloc.h>
+#include <memory>
+#include <new>
+#include "AllocationCounter.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+namespace
+{
+	// enough for a typical frame without growing
+	const std::size_t InitialBlockSize = 4 * 1024 * 1024;
+
+	// blocks start on a cache line so nothing handed out shares a line with
+	// another thread's arena
+	const std::size_t BlockAlignment = 64;
+
+	std::vector<std::unique_ptr<FrameArena>> & Arenas()
+	{
+		// one per job thread, indexed like the job system's threads
+		static std::vector<std::unique_ptr<FrameArena>> arenas = []()
+		{
+			std::vector<std::unique_ptr<FrameArena>> created;
+
+			for (unsigned i = 0; i < JobSystem::Get().GetNumThreads(); ++i)
+				created.emplace_back(new FrameArena);
+
+			return created;
+		}();
+
+		return arenas;
+	}
+}
+
+FrameArena & FrameArena::Get()
+{
+	return *Arenas()[JobSystem::GetThreadIndex()];
+}
+
+void FrameArena::ResetAll()
+{
+	for (auto && arena : Arenas())
+		arena->Reset();
+}
+
+FrameArena::FrameArena()
+{
+	m_blocks.reserve(8);
+}
+
+FrameArena::~FrameArena()
+{
+	for (auto && block : m_blocks)
+		_aligned_free(block.m_data);
+}
+
+void * FrameArena::Allocate(std::size_t size, std::size_t alignment)
+{
+	assert(alignment <= BlockAlignment && (alignment & (alignment - 1)) == 0);
+
+	if (! m_blocks.empty())
+	{
+		const Block & block = m_blocks.back();
+		const std::size_t start = (m_offset + alignment - 1) & ~(alignment - 1);
+
+		if (start + size <= block.m_size)
+		{
+			m_offset = start + size;
+			m_used += size;
+			return block.m_data + start;
+		}
+	}
+
+	// growing is expected while the first frames find out how much they
+	// need, after a reset it all fits in one block again
+	AllocationCounter::Allow allow;
+
+	const std::size_t blockSize = std::max(
+		m_blocks.empty() ? InitialBlockSize : m_blocks.back().m_size * 2,
+		size);
+
+	void * memory = _aligned_malloc(blockSize, BlockAlignment);
+
+	if (! memory)
+		throw std::bad_alloc();
+
+	m_blocks.push_back({ static_cast<char*>(memory), blockSize });
+
+	m_offset = size;
+	m_used += size;
+
+	return memory;
+}
+
+void FrameArena::Reset()
+{
+	if (m_blocks.size() > 1)
+	{
+		AllocationCounter::Allow allow;
+
+		std::size_t total = 0;
+
+		for (auto && block : m_blocks)
+		{
+			total += block.m_size;
+			_aligned_free(block.m_data);
+		}
+
+		m_blocks.clear();
+
+		void * memory = _aligned_malloc(total, BlockAlignment);
+
+		if (! memory)
+			throw std::bad_alloc();
+
+		m_blocks.push_back({ static_cast<char*>(memory), total });
+	}
+
+	m_offset = 0;
+	m_used = 0;
+}
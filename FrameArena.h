@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for data that only lives for one frame. Each job thread has
+// its own so allocating never takes a lock, and everything is given back at
+// once when the frame ends rather than freed piece by piece.
+class FrameArena
+{
+public:
+	// The calling thread's arena
+	static FrameArena & Get();
+
+	// Starts every thread's arena from empty. Nothing allocated before is
+	// valid afterwards, so this is only done between frames while no jobs
+	// are running.
+	static void ResetAll();
+
+	FrameArena();
+	~FrameArena();
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena & operator=(const FrameArena &) = delete;
+
+	void * Allocate(std::size_t size, std::size_t alignment);
+
+	// Uninitialised space for count Ts
+	template <typename T>
+	T * Allocate(std::size_t count)
+	{
+		return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	void Reset();
+
+	// Bytes handed out since the last reset
+	std::size_t GetUsed() const { return m_used; }
+
+private:
+	struct Block
+	{
+		char * m_data;
+		std::size_t m_size;
+	};
+
+	// a frame that doesn't fit adds another block, the next reset replaces
+	// them all with one block big enough for the lot
+	std::vector<Block> m_blocks;
+	std::size_t m_offset = 0;
+	std::size_t m_used = 0;
+};
+
+// Allocator for containers that are thrown away with the frame. Space comes
+// from the arena of whichever thread grows the container, so one built on
+// the main thread can still be filled in by a job. Nothing is given back
+// until the arena is reset.
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator()
+	{ }
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &)
+	{ }
+
+	T * allocate(std::size_t count)
+	{
+		return FrameArena::Get().Allocate<T>(count);
+	}
+
+	void deallocate(T *, std::size_t)
+	{ }
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U> &) const
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U> &) const
+	{
+		return false;
+	}
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
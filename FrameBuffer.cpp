@@ -1,11 +1,122 @@
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
+#include <emmintrin.h>
+#include <new>
+#include <stdexcept>
 
+#include "AllocationCounter.h"
 #include "FrameBuffer.h"
 #include "ScopedHDC.h"
 
-FrameBuffer::FrameBuffer(HWND hWnd)
-	: m_hWnd(hWnd)
+namespace
+{
+	// each channel of a cleared pixel, a mid grey
+	const unsigned char ClearByte = 128;
+
+	// as stored, GetDepth adds 2
+	const Real ClearDepth = 0.0f;
+
+	// a cleared pixel as it's shown
+	const uint32_t ClearDisplay = 0xff000000 | (ClearByte << 16) | (ClearByte << 8) | ClearByte;
+
+	// bilinear weights are out of this, small enough that a weighted 8 bit
+	// value fits in 16 bits
+	const unsigned WeightOne = 128;
+
+	const std::size_t CacheLine = 64;
+
+	// Tiles are a multiple of a cache line so with the buffer starting on
+	// one, each row of a 32 bit tile is exactly one line
+	template <typename T>
+	T * AllocateLines(std::size_t count)
+	{
+		AllocationCounter::Add();
+
+		void * memory = _aligned_malloc(count * sizeof(T), CacheLine);
+
+		if (! memory)
+			throw std::bad_alloc();
+
+		return static_cast<T*>(memory);
+	}
+
+	// For each of count destination pixels, the first of the two source
+	// pixels it falls between and their weights. The centres of the first
+	// and last pixels line up.
+	void ScaleSamples(unsigned count, unsigned sourceCount, uint32_t * sources, uint16_t * weights)
+	{
+		const float step = static_cast<float>(sourceCount) / count;
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			const float position = std::min(std::max((i + 0.5f) * step - 0.5f, 0.0f), sourceCount - 1.0f);
+
+			// the last pair starts one before the end so both are in range
+			const unsigned first = std::min(static_cast<unsigned>(position), sourceCount - 2);
+			const unsigned weight = static_cast<unsigned>((position - first) * WeightOne + 0.5f);
+
+			sources[i] = first;
+
+			for (unsigned j = 0; j < 4; ++j)
+			{
+				weights[i * 8 + j] = static_cast<uint16_t>(WeightOne - weight);
+				weights[i * 8 + 4 + j] = static_cast<uint16_t>(weight);
+			}
+		}
+	}
+
+	template <class Format>
+	void WritePixels(unsigned char * bytes, const FrameBuffer::Pixel * pixels, const Colour * colours, unsigned count)
+	{
+		typedef typename Format::Value Value;
+
+		Value * values = reinterpret_cast<Value *>(bytes);
+
+		for (unsigned i = 0; i < count; i += 4)
+		{
+			const unsigned n = std::min(count - i, 4u);
+
+			// a short last group repeats its last colour, only n are written
+			Colour group[4];
+
+			for (unsigned j = 0; j < 4; ++j)
+				group[j] = colours[i + std::min(j, n - 1)];
+
+			Value packed[4];
+			Format::Pack(group, packed);
+
+			for (unsigned j = 0; j < n; ++j)
+				values[pixels[i + j].m_index] = packed[j];
+		}
+	}
+
+	template <class Format>
+	void FillPixels(unsigned char * bytes, unsigned count)
+	{
+		typedef typename Format::Value Value;
+
+		const Colour grey(ClearByte / 255.0f, ClearByte / 255.0f, ClearByte / 255.0f);
+		const Colour group[4] = { grey, grey, grey, grey };
+
+		Value packed[4];
+		Format::Pack(group, packed);
+
+		std::fill_n(reinterpret_cast<Value *>(bytes), count, packed[0]);
+	}
+
+	template <class Format>
+	void ToDisplay(const unsigned char * bytes, uint32_t * display, unsigned count)
+	{
+		Format::ToDisplay(reinterpret_cast<const typename Format::Value *>(bytes), display, count);
+	}
+}
+
+FrameBuffer::FrameBuffer(HWND hWnd, PixelFormat format, Layout layout)
+	: m_tiled(layout == Layout::Tiled)
+	, m_format(format)
+	, m_hWnd(hWnd)
 {
 	ScopedHDC hdc(hWnd);
 	m_hDc = CreateCompatibleDC(hdc);
@@ -18,19 +129,110 @@ FrameBuffer::FrameBuffer(HWND hWnd)
 
 	SelectObject(m_hDc, m_hBitmap);
 
-	m_bytesPerPixel = GetDeviceCaps(m_hDc, BITSPIXEL) / 8;
+	// every format is shown by converting it to 32 bit
+	if (GetDeviceCaps(m_hDc, BITSPIXEL) != 32)
+		throw std::runtime_error("the display must be 32 bits per pixel");
+
+	m_bufferWidth = m_width;
+	m_bufferHeight = m_height;
 
-	m_pixels = m_width*m_height;
-	m_pBytes = new unsigned char [m_pixels * m_bytesPerPixel];
+	Allocate(kBuffers);
 
-	m_depthBuffer.reset(new Real [m_pixels]);
+	m_clearBrush = CreateSolidBrush(RGB(ClearByte, ClearByte, ClearByte));
+
+	// all up front, the present thread allocating would upset the counts
+	// that check drawing a frame doesn't
+	m_linear.reset(new uint32_t [m_pixels]);
+	m_scaled.reset(new uint32_t [m_pixels]);
+	m_sourceColumns.reset(new uint32_t [m_width]);
+	m_columnWeights.reset(new uint16_t [m_width * 8]);
+	m_sourceRows.reset(new uint32_t [m_height]);
+	m_rowWeights.reset(new uint16_t [m_height * 8]);
+
+	// the memory DC and bitmap belong to the present thread from here on
+	m_presentThread = std::thread([this]() { PresentLoop(); });
+}
+
+FrameBuffer::FrameBuffer(unsigned width, unsigned height, unsigned bucketWidth, unsigned bucketHeight,
+	PixelFormat format)
+	: m_width(width)
+	, m_height(height)
+	, m_bufferWidth(bucketWidth)
+	, m_bufferHeight(bucketHeight)
+	, m_tiled(true)
+	, m_format(format)
+{
+	Allocate(1);
 }
 
 FrameBuffer::~FrameBuffer()
 {
-	DeleteObject(m_hBitmap);
-	DeleteDC(m_hDc);
-	delete[] m_pBytes;
+	if (m_presentThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+
+		m_frameReady.notify_one();
+		m_presentThread.join();
+	}
+
+	if (m_hDc)
+	{
+		DeleteObject(m_clearBrush);
+		DeleteObject(m_hBitmap);
+		DeleteDC(m_hDc);
+	}
+}
+
+void FrameBuffer::Allocate(unsigned buffers)
+{
+	switch (m_format)
+	{
+	case PixelFormat::RGBA8: UseFormat<pixels::RGBA8>(); break;
+	case PixelFormat::BGRA8: UseFormat<pixels::BGRA8>(); break;
+	case PixelFormat::RGB565: UseFormat<pixels::RGB565>(); break;
+	case PixelFormat::RGBA16F: UseFormat<pixels::RGBA16F>(); break;
+	case PixelFormat::RGBA32F: UseFormat<pixels::RGBA32F>(); break;
+	default: throw std::runtime_error("unknown pixel format");
+	}
+
+	m_pixels = m_bufferWidth * m_bufferHeight;
+
+	m_tilesAcross = (m_bufferWidth + kTileSize - 1) / kTileSize;
+	m_tilesDown = (m_bufferHeight + kTileSize - 1) / kTileSize;
+
+	m_storedPixels = m_tiled ? m_tilesAcross * m_tilesDown * kTileSize * kTileSize : m_pixels;
+
+	// nothing has been drawn so every tile starts out cleared
+	for (unsigned i = 0; i < buffers; ++i)
+	{
+		ColourBuffer & buffer = m_buffers[i];
+
+		buffer.m_bytes.reset(AllocateLines<unsigned char>(m_storedPixels * m_bytesPerPixel));
+		buffer.m_cleared.reset(new uint8_t [m_tilesAcross * m_tilesDown]);
+		buffer.m_width = m_width;
+		buffer.m_height = m_height;
+		buffer.m_text[0] = '\0';
+
+		std::memset(buffer.m_cleared.get(), 1, m_tilesAcross * m_tilesDown);
+	}
+
+	m_pBytes = m_buffers[m_drawing].m_bytes.get();
+	m_pCleared = m_buffers[m_drawing].m_cleared.get();
+
+	m_depthBuffer.reset(AllocateLines<Real>(m_storedPixels));
+}
+
+template <class Format>
+void FrameBuffer::UseFormat()
+{
+	m_bytesPerPixel = sizeof(typename Format::Value);
+
+	m_writePixels = &WritePixels<Format>;
+	m_fillPixels = &FillPixels<Format>;
+	m_toDisplay = &ToDisplay<Format>;
 }
 
 void FrameBuffer::SetFillColour(const Colour &fill)
@@ -39,41 +241,432 @@ void FrameBuffer::SetFillColour(const Colour &fill)
 
 void FrameBuffer::Clear()
 {
-	std::memset(m_pBytes, 128, m_pixels * m_bytesPerPixel);
-	std::memset(m_depthBuffer.get(), 0, m_pixels * sizeof(Real));
+	Clear(0, m_bufferHeight);
+}
+
+void FrameBuffer::Clear(unsigned top, unsigned bottom)
+{
+	assert(top <= bottom && bottom <= m_bufferHeight);
+	assert(top % kTileSize == 0 && (bottom % kTileSize == 0 || bottom == m_bufferHeight));
+
+	const unsigned first = (top / kTileSize) * m_tilesAcross;
+	const unsigned last = ((bottom + kTileSize - 1) / kTileSize) * m_tilesAcross;
+
+	std::memset(m_pCleared + first, 1, last - first);
+}
+
+void FrameBuffer::Clear(unsigned left, unsigned top, unsigned right, unsigned bottom)
+{
+	assert(left <= right && right <= m_bufferWidth && top <= bottom && bottom <= m_bufferHeight);
+	assert(left % kTileSize == 0 && top % kTileSize == 0);
+
+	const unsigned first = left / kTileSize;
+	const unsigned last = (right + kTileSize - 1) / kTileSize;
+
+	for (unsigned row = top / kTileSize; row < (bottom + kTileSize - 1) / kTileSize; ++row)
+		std::memset(m_pCleared + row * m_tilesAcross + first, 1, last - first);
+}
+
+void FrameBuffer::KeepPrevious()
+{
+	assert(m_presentThread.joinable() && m_presented != kBuffers && m_presented != m_drawing);
+
+	const ColourBuffer & previous = m_buffers[m_presented];
+
+	assert(previous.m_width == m_width && previous.m_height == m_height);
+
+	// the present thread only reads it so there's no need to lock
+	std::memcpy(m_pBytes, previous.m_bytes.get(), m_storedPixels * m_bytesPerPixel);
+	std::memcpy(m_pCleared, previous.m_cleared.get(), m_tilesAcross * m_tilesDown);
+}
+
+void FrameBuffer::MaterialiseTile(unsigned tile)
+{
+	if (m_tiled)
+	{
+		const unsigned start = tile * kTileSize * kTileSize;
+
+		m_fillPixels(m_pBytes + start * m_bytesPerPixel, kTileSize * kTileSize);
+		std::fill_n(m_depthBuffer.get() + start, kTileSize * kTileSize, ClearDepth);
+
+		m_pCleared[tile] = 0;
+		return;
+	}
+
+	const unsigned left = (tile % m_tilesAcross) * kTileSize;
+	const unsigned top = (tile / m_tilesAcross) * kTileSize;
+
+	// tiles on the right and bottom edges can be cut short
+	const unsigned width = std::min(m_bufferWidth - left, kTileSize + 0);
+	const unsigned bottom = std::min(top + kTileSize, m_bufferHeight);
+
+	for (unsigned y = top; y < bottom; ++y)
+	{
+		const unsigned start = y * m_bufferWidth + left;
+
+		m_fillPixels(m_pBytes + start * m_bytesPerPixel, width);
+		std::fill_n(m_depthBuffer.get() + start, width, ClearDepth);
+	}
+
+	m_pCleared[tile] = 0;
+}
+
+void FrameBuffer::ReadBucketRow(unsigned y, unsigned char * values) const
+{
+	assert(y < m_bufferHeight);
+
+	const unsigned tileRow = y / kTileSize;
+
+	for (unsigned column = 0; column < m_tilesAcross; ++column)
+	{
+		const unsigned tile = tileRow * m_tilesAcross + column;
+		const unsigned left = column * kTileSize;
+		const unsigned width = std::min(m_bufferWidth - left, kTileSize + 0);
+
+		unsigned char * destination = values + left * m_bytesPerPixel;
+
+		if (m_pCleared[tile])
+		{
+			m_fillPixels(destination, width);
+			continue;
+		}
+
+		const unsigned start = m_tiled ?
+			(tile * kTileSize + y % kTileSize) * kTileSize :
+			y * m_bufferWidth + left;
+
+		std::memcpy(destination, m_pBytes + start * m_bytesPerPixel, width * m_bytesPerPixel);
+	}
 }
 
-void FrameBuffer::CopyToWindow()
+void FrameBuffer::SetRenderSize(unsigned width, unsigned height)
 {
-	SetBitmapBits(m_hBitmap, m_pixels * m_bytesPerPixel, m_pBytes);
+	assert(m_presentThread.joinable());
+	assert(width >= 2 && width <= m_bufferWidth && height >= 2 && height <= m_bufferHeight);
 
+	m_width = width;
+	m_height = height;
+}
+
+void FrameBuffer::Present()
+{
+	assert(m_presentThread.joinable());
+
+	m_buffers[m_drawing].m_width = m_width;
+	m_buffers[m_drawing].m_height = m_height;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_ready = m_drawing;
+		m_presented = m_drawing;
+
+		// with three buffers there's always one that is neither waiting nor
+		// being shown
+		for (unsigned i = 0; i < kBuffers; ++i)
+		{
+			if (i != m_ready && i != m_presenting)
+			{
+				m_drawing = i;
+				break;
+			}
+		}
+
+		assert(m_drawing != m_ready);
+	}
+
+	m_pBytes = m_buffers[m_drawing].m_bytes.get();
+	m_pCleared = m_buffers[m_drawing].m_cleared.get();
+
+	m_frameReady.notify_one();
+}
+
+void FrameBuffer::ShowAgain()
+{
+	assert(m_presentThread.joinable());
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_showAgain = true;
+
+		std::memcpy(m_againText, m_buffers[m_drawing].m_text, kMaxOverlayText);
+	}
+
+	m_frameReady.notify_one();
+}
+
+void FrameBuffer::SetOverlayText(const char * text)
+{
+	char * destination = m_buffers[m_drawing].m_text;
+
+	std::strncpy(destination, text, kMaxOverlayText - 1);
+	destination[kMaxOverlayText - 1] = '\0';
+}
+
+void FrameBuffer::PresentLoop()
+{
+	while (true)
+	{
+		unsigned buffer;
+		const char * text;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_frameReady.wait(lock, [this]() { return m_quit || m_ready != kBuffers || m_showAgain; });
+
+			if (m_quit)
+				return;
+
+			// showing a new frame covers showing the last one again
+			const bool again = m_showAgain && m_ready == kBuffers;
+
+			m_showAgain = false;
+
+			if (again)
+			{
+				// the bitmap still holds the last frame, it only has to be
+				// made again when the text over it has changed
+				if (m_presented == kBuffers || std::strcmp(m_againText, m_shownText) == 0)
+				{
+					lock.unlock();
+
+					Blit();
+					continue;
+				}
+
+				std::memcpy(m_shownText, m_againText, kMaxOverlayText);
+
+				// Present won't start drawing into it while it's being shown
+				buffer = m_presented;
+				text = m_shownText;
+			}
+			else
+			{
+				buffer = m_ready;
+				text = m_buffers[buffer].m_text;
+
+				std::memcpy(m_shownText, text, kMaxOverlayText);
+			}
+
+			m_presenting = buffer;
+			m_ready = kBuffers;
+		}
+
+		const ColourBuffer & colour = m_buffers[buffer];
+
+		const bool scaled = colour.m_width != m_bufferWidth || colour.m_height != m_bufferHeight;
+
+		const void * bytes = colour.m_bytes.get();
+
+		// the GDI bitmap's own layout can be handed over as it is
+		if (scaled || m_tiled || m_format != PixelFormat::BGRA8)
+		{
+			Resolve(colour.m_bytes.get(), colour.m_cleared.get());
+			bytes = m_linear.get();
+		}
+
+		if (scaled)
+		{
+			FillCleared(colour.m_cleared.get(), colour.m_width, colour.m_height);
+			Upscale(colour.m_width, colour.m_height);
+
+			bytes = m_scaled.get();
+		}
+
+		SetBitmapBits(m_hBitmap, m_pixels * sizeof(uint32_t), bytes);
+
+		// tiles that were never drawn to still hold an old frame, GDI fills
+		// each run of them along a row of tiles instead
+		for (unsigned row = 0; row < m_tilesDown && ! scaled; ++row)
+		{
+			const uint8_t * cleared = colour.m_cleared.get() + row * m_tilesAcross;
+
+			unsigned column = 0;
+
+			while (column < m_tilesAcross)
+			{
+				if (! cleared[column])
+				{
+					++column;
+					continue;
+				}
+
+				const unsigned start = column;
+
+				while (column < m_tilesAcross && cleared[column])
+					++column;
+
+				const RECT rect = {
+					static_cast<LONG>(start * kTileSize),
+					static_cast<LONG>(row * kTileSize),
+					static_cast<LONG>(std::min(column * kTileSize, m_bufferWidth)),
+					static_cast<LONG>(std::min((row + 1) * kTileSize, m_bufferHeight)),
+				};
+
+				FillRect(m_hDc, &rect, m_clearBrush);
+			}
+		}
+
+		// into the bitmap rather than onto the window so that the next blit
+		// doesn't make it flicker
+		TextOut(m_hDc, 5, 5, text, static_cast<int>(std::strlen(text)));
+
+		Blit();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_presenting = kBuffers;
+	}
+}
+
+void FrameBuffer::Blit()
+{
 	ScopedHDC hdc(m_hWnd);
 
 	assert(hdc);
 
-	BOOL res = BitBlt(hdc, 0, 0, m_width, m_height, m_hDc, 0, 0, SRCCOPY);
+	BitBlt(hdc, 0, 0, m_bufferWidth, m_bufferHeight, m_hDc, 0, 0, SRCCOPY);
+}
+
+void FrameBuffer::Resolve(const unsigned char * bytes, const uint8_t * cleared)
+{
+	if (! m_tiled)
+	{
+		m_toDisplay(bytes, m_linear.get(), m_pixels);
+		return;
+	}
+
+	const unsigned tileBytes = kTileSize * kTileSize * m_bytesPerPixel;
+	const unsigned rowBytes = kTileSize * m_bytesPerPixel;
+
+	for (unsigned tile = 0; tile < m_tilesAcross * m_tilesDown; ++tile)
+	{
+		const unsigned left = (tile % m_tilesAcross) * kTileSize;
+		const unsigned top = (tile / m_tilesAcross) * kTileSize;
+
+		// cleared tiles are about to be filled over by GDI anyway
+		if (cleared[tile])
+			continue;
+
+		const unsigned width = std::min(m_bufferWidth - left, kTileSize + 0);
+		const unsigned rows = std::min(m_bufferHeight - top, kTileSize + 0);
+
+		const unsigned char * source = bytes + tile * tileBytes;
+		uint32_t * destination = m_linear.get() + top * m_bufferWidth + left;
+
+		for (unsigned row = 0; row < rows; ++row)
+		{
+			m_toDisplay(source, destination, width);
+
+			source += rowBytes;
+			destination += m_bufferWidth;
+		}
+	}
+}
+
+void FrameBuffer::FillCleared(const uint8_t * cleared, unsigned width, unsigned height)
+{
+	const unsigned tilesAcross = (width + kTileSize - 1) / kTileSize;
+	const unsigned tilesDown = (height + kTileSize - 1) / kTileSize;
+
+	for (unsigned row = 0; row < tilesDown; ++row)
+	{
+		for (unsigned column = 0; column < tilesAcross; ++column)
+		{
+			if (! cleared[row * m_tilesAcross + column])
+				continue;
+
+			const unsigned left = column * kTileSize;
+			const unsigned top = row * kTileSize;
+			const unsigned right = std::min(left + kTileSize, width);
+			const unsigned bottom = std::min(top + kTileSize, height);
+
+			for (unsigned y = top; y < bottom; ++y)
+				std::fill(m_linear.get() + y * m_bufferWidth + left, m_linear.get() + y * m_bufferWidth + right, ClearDisplay);
+		}
+	}
+}
+
+void FrameBuffer::Upscale(unsigned width, unsigned height)
+{
+	if (width != m_scaledFromWidth || height != m_scaledFromHeight)
+	{
+		ScaleSamples(m_bufferWidth, width, m_sourceColumns.get(), m_columnWeights.get());
+		ScaleSamples(m_bufferHeight, height, m_sourceRows.get(), m_rowWeights.get());
+
+		m_scaledFromWidth = width;
+		m_scaledFromHeight = height;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi16(WeightOne / 2);
+
+	for (unsigned y = 0; y < m_bufferHeight; ++y)
+	{
+		const uint32_t * top = m_linear.get() + m_sourceRows[y] * m_bufferWidth;
+		const uint32_t * bottom = top + m_bufferWidth;
+
+		const __m128i rowWeights = _mm_loadu_si128(reinterpret_cast<const __m128i *>(m_rowWeights.get() + y * 8));
+
+		// the top row's weight in the low four lanes and the bottom's in
+		// the high four, each channel of a pixel in its own lane
+		const __m128i topWeight = _mm_unpacklo_epi64(rowWeights, rowWeights);
+		const __m128i bottomWeight = _mm_unpackhi_epi64(rowWeights, rowWeights);
+
+		uint32_t * destination = m_scaled.get() + y * m_bufferWidth;
+
+		for (unsigned x = 0; x < m_bufferWidth; ++x)
+		{
+			const unsigned source = m_sourceColumns[x];
+
+			const __m128i columnWeights = _mm_loadu_si128(reinterpret_cast<const __m128i *>(m_columnWeights.get() + x * 8));
+
+			// two neighbouring pixels of each row, widened to 16 bits
+			__m128i upper = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(top + source)), zero);
+			__m128i lower = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(bottom + source)), zero);
+
+			upper = _mm_mullo_epi16(upper, columnWeights);
+			lower = _mm_mullo_epi16(lower, columnWeights);
+
+			// the left and right pixels' halves summed and back to 8 bits,
+			// otherwise weighting again would overflow
+			upper = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(upper, _mm_srli_si128(upper, 8)), half), 7);
+			lower = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lower, _mm_srli_si128(lower, 8)), half), 7);
+
+			__m128i blended = _mm_add_epi16(_mm_mullo_epi16(upper, topWeight), _mm_mullo_epi16(lower, bottomWeight));
+			blended = _mm_srli_epi16(_mm_add_epi16(blended, half), 7);
+
+			destination[x] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(blended, blended)));
+		}
+	}
 }
 
-void FrameBuffer::SetPixel(unsigned x, unsigned y, const Colour &colour)
+void FrameBuffer::SetPixel(const Pixel &pixel, const Colour &colour)
 {
-	unsigned char r = colour.r * 255;
-	unsigned char g = colour.g * 255;
-	unsigned char b = colour.b * 255;
-	unsigned start = (x * m_bytesPerPixel)  + (y * m_width * m_bytesPerPixel);
+	SetPixels(&pixel, &colour, 1);
+}
+
+void FrameBuffer::SetPixels(const Pixel *pixels, const Colour *colours, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i)
+		Materialise(pixels[i].m_tile);
 
-	// TODO/FIXME: assuming 4 bytes per pixel
-	m_pBytes[start] = r;
-	m_pBytes[start+1] = g;
-	m_pBytes[start+2] = b;
-	m_pBytes[start+3] = 0xff;
+	m_writePixels(m_pBytes, pixels, colours, count);
 }
 
-Real FrameBuffer::GetDepth(unsigned x, unsigned y) const
+Real FrameBuffer::GetDepth(const Pixel &pixel) const
 {
-	return m_depthBuffer[y * m_width + x] + 2.0;
+	// a cleared tile's depth may be stale, the test is cheaper than filling
+	// it in just to read it
+	if (m_pCleared[pixel.m_tile])
+		return ClearDepth + 2.0;
+
+	return m_depthBuffer[pixel.m_index] + 2.0;
 }
 
-void FrameBuffer::SetDepth(unsigned x, unsigned y, Real depth)
+void FrameBuffer::SetDepth(const Pixel &pixel, Real depth)
 {
-	m_depthBuffer[y * m_width + x] = depth - 2.0;
+	Materialise(pixel.m_tile);
+
+	m_depthBuffer[pixel.m_index] = depth - 2.0;
 }
@@ -1,36 +1,289 @@
 #pragma once
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <malloc.h>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <Windows.h>
 #include "Colour.h"
+#include "PixelFormat.h"
 
+// Colour is drawn into one of several buffers while a thread of its own
+// copies finished ones to the window, so showing one frame overlaps drawing
+// the next. Depth is never shown so there's only one depth buffer.
+//
+// Clearing doesn't touch the pixels, it marks tiles as cleared. A tile is
+// filled with the clear colour and depth the first time it's drawn to and
+// tiles that never are get filled in by GDI when the frame is shown, so an
+// empty part of the screen costs no memory bandwidth at all.
+//
+// Pixels are normally stored a tile at a time rather than a row at a time,
+// so the pixels of a small triangle share a few cache lines instead of
+// touching a line in every row it covers. The present thread puts the rows
+// back together before they're shown.
+//
+// Colour can be stored in any of the PixelFormats. The loops that write and
+// show pixels are instantiated for each and picked once when the buffer is
+// made, the 16 bit and float formats cost nothing when they aren't used.
+//
+// The frame drawn for a window can be smaller than the window, it's scaled
+// up to fill it when it's shown.
+//
+// When only part of a frame changes the next one can start as a copy of the
+// last and clear just that part, the depth buffer still holds what was
+// drawn there.
+//
+// A buffer without a window is for images too big to keep whole. It only
+// stores a bucket of the image at a time, coordinates are still those of the
+// whole image and only the bucket is drawn to.
 class FrameBuffer
 {
 public:
-	FrameBuffer(HWND hWnd);
+	enum class Layout
+	{
+		Linear,
+		Tiled,
+	};
+
+	// Where a pixel's colour and depth are stored, from Locate
+	struct Pixel
+	{
+		unsigned m_index;
+		unsigned m_tile;
+	};
+
+	// Tiles are square, bands of rows split on these boundaries never share
+	// a tile so they can be drawn from different threads
+	static const unsigned kTileSize = 16;
+
+	FrameBuffer(HWND hWnd, PixelFormat format = PixelFormat::BGRA8, Layout layout = Layout::Tiled);
+
+	// A width x height image drawn bucketWidth x bucketHeight at a time,
+	// there's no present thread and Present can't be used
+	FrameBuffer(unsigned width, unsigned height, unsigned bucketWidth, unsigned bucketHeight,
+		PixelFormat format = PixelFormat::BGRA8);
+
 	~FrameBuffer();
 
+	// Moves the bucket so its top left is left, top in the image. Nothing
+	// drawn before is kept so it should be cleared again.
+	void SetBucket(unsigned left, unsigned top)
+	{
+		m_left = left;
+		m_top = top;
+	}
+
+	// Row y of the bucket from its top, bucketWidth pixels in the stored
+	// format. Tiles that weren't drawn to come out as the clear colour.
+	void ReadBucketRow(unsigned y, unsigned char * values) const;
+
 	void SetFillColour(const Colour &fill);
 	void Clear();
-	void CopyToWindow();
 
-	void SetPixel(unsigned x, unsigned y, const Colour &colour);
+	// Just rows top to bottom - 1 of what's stored, both on tile boundaries
+	// unless bottom is the height
+	void Clear(unsigned top, unsigned bottom);
+
+	// Every tile with a pixel in columns left to right - 1 of rows top to
+	// bottom - 1, left and top on tile boundaries
+	void Clear(unsigned left, unsigned top, unsigned right, unsigned bottom);
+
+	// Starts the frame as a copy of the one last handed to Present, which
+	// has to have been drawn at the current render size. Only for a buffer
+	// with a window.
+	void KeepPrevious();
+
+	// Hands what has been drawn to the present thread and moves drawing on
+	// to a free buffer. A frame still waiting to be shown is older than this
+	// one so it's dropped rather than waited for, drawing never stalls on
+	// the window.
+	void Present();
+
+	// Shows the last frame again without drawing one, for when the window
+	// needs painting but nothing in it has changed. The overlay text set
+	// since is drawn over it instead of the frame's own.
+	void ShowAgain();
+
+	// Drawn over the frame when it's shown, the text is copied
+	void SetOverlayText(const char * text);
+
+	// The size the next frames are drawn at, no bigger than the window and
+	// at least 2 x 2. Only for a buffer with a window.
+	void SetRenderSize(unsigned width, unsigned height);
+
+	Pixel Locate(unsigned x, unsigned y) const
+	{
+		x -= m_left;
+		y -= m_top;
 
-	Real GetDepth(unsigned x, unsigned y) const;
-	void SetDepth(unsigned x, unsigned y, Real depth);
+		const unsigned tile = TileAt(x, y);
 
+		if (! m_tiled)
+			return { y * m_bufferWidth + x, tile };
+
+		return { (tile * kTileSize + y % kTileSize) * kTileSize + x % kTileSize, tile };
+	}
+
+	void SetPixel(const Pixel &pixel, const Colour &colour);
+
+	// Converting to the stored format is done four pixels at a time so a
+	// whole span's worth of shaded pixels is better written in one go
+	void SetPixels(const Pixel *pixels, const Colour *colours, unsigned count);
+
+	Real GetDepth(const Pixel &pixel) const;
+	void SetDepth(const Pixel &pixel, Real depth);
+
+	PixelFormat GetFormat() const { return m_format; }
+
+	// Of the whole image being drawn
 	unsigned GetWidth() const { return m_width; }
 	unsigned GetHeight() const { return m_height; }
 
+	// Of what's stored, the window or a bucket
+	unsigned GetStoredWidth() const { return m_bufferWidth; }
+	unsigned GetStoredHeight() const { return m_bufferHeight; }
+
 private:
+	// Everything but the window, count colour buffers of the stored size
+	void Allocate(unsigned buffers);
+
+	void PresentLoop();
+
+	// Copies the bitmap to the window, only from the present thread
+	void Blit();
+
+	unsigned TileAt(unsigned x, unsigned y) const
+	{
+		return (y / kTileSize) * m_tilesAcross + x / kTileSize;
+	}
+
+	// Fills a tile that is still marked as cleared with the clear values
+	void Materialise(unsigned tile)
+	{
+		if (m_pCleared[tile])
+			MaterialiseTile(tile);
+	}
+
+	void MaterialiseTile(unsigned tile);
+
+	// Converts the tiles of a frame that were drawn to into rows of m_linear
+	void Resolve(const unsigned char * bytes, const uint8_t * cleared);
+
+	// Puts the clear colour into m_linear where the tiles of a width x
+	// height frame weren't drawn to
+	void FillCleared(const uint8_t * cleared, unsigned width, unsigned height);
+
+	// Bilinear filters the width x height frame in m_linear up to the
+	// window's size in m_scaled
+	void Upscale(unsigned width, unsigned height);
+
+	template <class Format>
+	void UseFormat();
+
+private:
+	// one being drawn, one waiting and one being shown
+	static const unsigned kBuffers = 3;
+
+	static const std::size_t kMaxOverlayText = 256;
+
+	// For colour and depth, which start on a cache line
+	struct AlignedFree
+	{
+		void operator()(void * pointer) const { _aligned_free(pointer); }
+	};
+
+	struct ColourBuffer
+	{
+		std::unique_ptr<unsigned char[], AlignedFree> m_bytes;
+
+		// a byte a tile rather than a bit so that threads drawing
+		// neighbouring tiles don't write to the same byte
+		std::unique_ptr<uint8_t[]> m_cleared;
+
+		// the size the frame was drawn at
+		unsigned m_width;
+		unsigned m_height;
+
+		char m_text[kMaxOverlayText];
+	};
+
 	unsigned m_width;
 	unsigned m_height;
+
+	// what's stored and where it is in the image, the whole image unless
+	// drawing a bucket at a time
+	unsigned m_bufferWidth;
+	unsigned m_bufferHeight;
+	unsigned m_left = 0;
+	unsigned m_top = 0;
+
 	unsigned m_pixels;
+	bool m_tiled;
+
+	// of the stored format, what's shown is always 32 bit
+	PixelFormat m_format;
 	unsigned m_bytesPerPixel;
+
+	// the loops for m_format
+	void (*m_writePixels)(unsigned char * bytes, const Pixel * pixels, const Colour * colours, unsigned count);
+	void (*m_fillPixels)(unsigned char * bytes, unsigned count);
+	void (*m_toDisplay)(const unsigned char * bytes, uint32_t * display, unsigned count);
+
+	// more than m_pixels when tiled as edge tiles are stored whole
+	unsigned m_storedPixels;
+	unsigned m_tilesAcross;
+	unsigned m_tilesDown;
+
+	// the bytes and tile marks of m_buffers[m_drawing], the depth buffer's
+	// tiles are always in step with these
 	unsigned char *m_pBytes;
-	HWND m_hWnd;
-	HDC m_hDc;
-	HBITMAP m_hBitmap;
+	uint8_t *m_pCleared;
+
+	// all null without a window
+	HBRUSH m_clearBrush = nullptr;
+	HWND m_hWnd = nullptr;
+	HDC m_hDc = nullptr;
+	HBITMAP m_hBitmap = nullptr;
 	Colour m_fillColour;
-	std::unique_ptr<Real[]> m_depthBuffer;
+	std::unique_ptr<Real[], AlignedFree> m_depthBuffer;
+
+	// Only used by the present thread. Rows put back together and converted
+	// for GDI, then scaled up to the window's size when drawn smaller.
+	std::unique_ptr<uint32_t[]> m_linear;
+	std::unique_ptr<uint32_t[]> m_scaled;
+
+	// The left source column of each column of the window and the weights
+	// of it and the next as 4 x 16 bits each, and the same for rows. Worked
+	// out again when the size drawn at changes.
+	std::unique_ptr<uint32_t[]> m_sourceColumns;
+	std::unique_ptr<uint16_t[]> m_columnWeights;
+	std::unique_ptr<uint32_t[]> m_sourceRows;
+	std::unique_ptr<uint16_t[]> m_rowWeights;
+	unsigned m_scaledFromWidth = 0;
+	unsigned m_scaledFromHeight = 0;
+
+	ColourBuffer m_buffers[kBuffers];
+
+	// m_drawing is only changed by Present, the rest are kBuffers when
+	// there's no such buffer and are guarded by m_mutex
+	unsigned m_drawing = 0;
+	unsigned m_ready = kBuffers;
+	unsigned m_presenting = kBuffers;
+
+	// the last buffer handed to Present, never the one being drawn so
+	// KeepPrevious can read it while it's being shown
+	unsigned m_presented = kBuffers;
+	bool m_showAgain = false;
+	char m_againText[kMaxOverlayText];
+
+	// what's drawn over the bitmap, only used by the present thread
+	char m_shownText[kMaxOverlayText] = {};
+
+	std::mutex m_mutex;
+	std::condition_variable m_frameReady;
+	bool m_quit = false;
+	std::thread m_presentThread;
 };
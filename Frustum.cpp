@@ -0,0 +1,137 @@
+#include <limits>
+#include <xmmintrin.h>
+#include "Frustum.h"
+
+namespace
+{
+	// The largest and smallest that n * v can be for v anywhere in the box.
+	// Picking a corner with the signs of the normal comes to the same thing
+	// but without a branch per component.
+	inline __m128 Furthest(__m128 n, __m128 min, __m128 max)
+	{
+		return _mm_max_ps(_mm_mul_ps(n, min), _mm_mul_ps(n, max));
+	}
+
+	inline __m128 Nearest(__m128 n, __m128 min, __m128 max)
+	{
+		return _mm_min_ps(_mm_mul_ps(n, min), _mm_mul_ps(n, max));
+	}
+}
+
+Frustum::Frustum(const Matrix4 & viewProjection)
+{
+	// http://www.cs.otago.ac.nz/postgrads/alexis/planeExtraction.pdf
+
+	// clip space is -w <= x, y, z <= w so each plane is the last row plus or
+	// minus one of the others
+
+	const Matrix4 & m = viewProjection;
+
+	for (unsigned i = 0; i < 6; ++i)
+	{
+		const unsigned row = i / 2;
+		const Real sign = (i % 2 == 0) ? 1.0f : -1.0f;
+
+		Vector3 normal = {
+			m(3, 0) + sign * m(row, 0),
+			m(3, 1) + sign * m(row, 1),
+			m(3, 2) + sign * m(row, 2),
+		};
+
+		Real distance = m(3, 3) + sign * m(row, 3);
+
+		// normalized so that the sphere test can compare against a radius
+		const Real length = normal.Length();
+
+		m_x[i] = normal.x / length;
+		m_y[i] = normal.y / length;
+		m_z[i] = normal.z / length;
+		m_distance[i] = distance / length;
+	}
+
+	for (unsigned i = 6; i < NumPlanes; ++i)
+	{
+		m_x[i] = m_y[i] = m_z[i] = 0.0f;
+		m_distance[i] = std::numeric_limits<Real>::max();
+	}
+}
+
+bool Frustum::Intersects(const geometry::BoundingSphere & sphere) const
+{
+	const __m128 cx = _mm_set1_ps(sphere.m_centre.x);
+	const __m128 cy = _mm_set1_ps(sphere.m_centre.y);
+	const __m128 cz = _mm_set1_ps(sphere.m_centre.z);
+	const __m128 radius = _mm_set1_ps(-sphere.m_radius);
+
+	for (unsigned i = 0; i < NumPlanes; i += 4)
+	{
+		const __m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m_x + i), cx), _mm_mul_ps(_mm_loadu_ps(m_y + i), cy)),
+			_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m_z + i), cz), _mm_loadu_ps(m_distance + i)));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(distance, radius)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+bool Frustum::Intersects(const geometry::BoundingBox & box) const
+{
+	const __m128 minX = _mm_set1_ps(box.m_min.x);
+	const __m128 minY = _mm_set1_ps(box.m_min.y);
+	const __m128 minZ = _mm_set1_ps(box.m_min.z);
+	const __m128 maxX = _mm_set1_ps(box.m_max.x);
+	const __m128 maxY = _mm_set1_ps(box.m_max.y);
+	const __m128 maxZ = _mm_set1_ps(box.m_max.z);
+
+	for (unsigned i = 0; i < NumPlanes; i += 4)
+	{
+		// the corner furthest along the plane normal, if that is outside the
+		// whole box is
+		const __m128 furthest = _mm_add_ps(
+			_mm_add_ps(Furthest(_mm_loadu_ps(m_x + i), minX, maxX), Furthest(_mm_loadu_ps(m_y + i), minY, maxY)),
+			_mm_add_ps(Furthest(_mm_loadu_ps(m_z + i), minZ, maxZ), _mm_loadu_ps(m_distance + i)));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(furthest, _mm_setzero_ps())) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+Containment Frustum::Classify(const geometry::BoundingBox & box) const
+{
+	const __m128 minX = _mm_set1_ps(box.m_min.x);
+	const __m128 minY = _mm_set1_ps(box.m_min.y);
+	const __m128 minZ = _mm_set1_ps(box.m_min.z);
+	const __m128 maxX = _mm_set1_ps(box.m_max.x);
+	const __m128 maxY = _mm_set1_ps(box.m_max.y);
+	const __m128 maxZ = _mm_set1_ps(box.m_max.z);
+
+	Containment result = Containment::Inside;
+
+	for (unsigned i = 0; i < NumPlanes; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(m_x + i);
+		const __m128 y = _mm_loadu_ps(m_y + i);
+		const __m128 z = _mm_loadu_ps(m_z + i);
+		const __m128 d = _mm_loadu_ps(m_distance + i);
+
+		const __m128 furthest = _mm_add_ps(
+			_mm_add_ps(Furthest(x, minX, maxX), Furthest(y, minY, maxY)),
+			_mm_add_ps(Furthest(z, minZ, maxZ), d));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(furthest, _mm_setzero_ps())) != 0)
+			return Containment::Outside;
+
+		const __m128 nearest = _mm_add_ps(
+			_mm_add_ps(Nearest(x, minX, maxX), Nearest(y, minY, maxY)),
+			_mm_add_ps(Nearest(z, minZ, maxZ), d));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(nearest, _mm_setzero_ps())) != 0)
+			result = Containment::Intersects;
+	}
+
+	return result;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Geometry.h"
+#include "Matrix.h"
+#include "Types.h"
+#include "Vector.h"
+
+enum class Containment
+{
+	Outside,
+	Intersects,
+	Inside,
+};
+
+class Frustum
+{
+public:
+	// Extracts the six clip planes from a combined projection * view matrix so
+	// that the planes are in world space
+	explicit Frustum(const Matrix4 & viewProjection);
+
+	// Both tests are conservative, they only return false when the volume is
+	// entirely outside one of the planes
+	bool Intersects(const geometry::BoundingSphere & sphere) const;
+	bool Intersects(const geometry::BoundingBox & box) const;
+
+	// Also tells the caller when the box is entirely inside so that a
+	// hierarchy can accept a whole subtree without testing further
+	Containment Classify(const geometry::BoundingBox & box) const;
+
+private:
+	// Four planes are tested at once so they're stored a component at a time.
+	// A point p is inside plane i when
+	// m_x[i] * p.x + m_y[i] * p.y + m_z[i] * p.z + m_distance[i] >= 0,
+	// the last two are padding that everything is inside.
+	static const unsigned NumPlanes = 8;
+
+	Real m_x[NumPlanes];
+	Real m_y[NumPlanes];
+	Real m_z[NumPlanes];
+	Real m_distance[NumPlanes];
+};
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include "Geometry.h"
+#include "MeshOptimiser.h"
+#include "MeshSimplifier.h"
+#include "SimdMath.h"
+#include "VertexCompression.h"
+
+namespace
+{
+	struct VertexKey
+	{
+		Vector3 position;
+		Vector3 normal;
+
+		bool operator==(const VertexKey & rhs) const
+		{
+			return position == rhs.position && normal == rhs.normal;
+		}
+	};
+
+	struct VertexKeyHash
+	{
+		std::size_t operator()(const VertexKey & key) const
+		{
+			const Real values[6] = {
+				key.position.x, key.position.y, key.position.z,
+				key.normal.x, key.normal.y, key.normal.z,
+			};
+
+			std::size_t hash = 2166136261u;
+
+			for (Real value : values)
+			{
+				// -0.0 compares equal to 0.0 so has to hash the same
+				if (value == 0.0f)
+					value = 0.0f;
+
+				uint32_t bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+
+				hash = (hash ^ bits) * 16777619u;
+			}
+
+			return hash;
+		}
+	};
+}
+
+namespace geometry
+{
+
+std::vector<FacePlane> ComputeFacePlanes(ArrayView<Vector3> positions, ArrayView<uint32_t> indices)
+{
+	const std::size_t triangles = indices.size() / 3;
+
+	std::vector<FacePlane> planes(triangles);
+
+	for (std::size_t i = 0; i < triangles; ++i)
+	{
+		const Vector3 & p0 = positions[indices[i * 3]];
+		const Vector3 & p1 = positions[indices[i * 3 + 1]];
+		const Vector3 & p2 = positions[indices[i * 3 + 2]];
+
+		// same winding as Triangle::Normal, only the sign of the test matters
+		// so there's no need to normalize
+		Vector3 normal = Triangle(p0, p1, p2).Normal();
+
+		planes[i] = { normal, normal.Dot(p0) };
+	}
+
+	return planes;
+}
+
+void Object::SetTriangles(const std::vector<Triangle> & triangles)
+{
+	std::unordered_map<VertexKey, uint32_t, VertexKeyHash> shared;
+
+	m_positions.clear();
+	m_normals.clear();
+	m_indices.clear();
+
+	m_indices.reserve(triangles.size() * 3);
+
+	for (auto && triangle : triangles)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			VertexKey key = { triangle.points[i], triangle.normals[i] };
+
+			auto iter = shared.find(key);
+
+			if (iter == shared.end())
+			{
+				const uint32_t index = static_cast<uint32_t>(m_positions.size());
+
+				m_positions.push_back(key.position);
+				m_normals.push_back(key.normal);
+
+				iter = shared.emplace(key, index).first;
+			}
+
+			m_indices.push_back(iter->second);
+		}
+	}
+
+	BuffersChanged();
+}
+
+std::size_t Object::AddInstance(const Matrix4 & model, const Colour & colour)
+{
+	m_instances.push_back({ model, colour });
+
+	TransformBounds(m_instances.back());
+	m_mergeBounds = true;
+	++m_version;
+
+	return m_instances.size() - 1;
+}
+
+void Object::RemoveInstances()
+{
+	m_instances.resize(1);
+	m_mergeBounds = true;
+	++m_version;
+}
+
+void Object::SetInstanceModelMatrix(std::size_t index, const Matrix4 & model)
+{
+	m_instances[index].m_model = model;
+
+	TransformBounds(m_instances[index]);
+	m_mergeBounds = true;
+	++m_version;
+}
+
+std::size_t Object::GetNumVertices() const
+{
+	return m_compressed ? m_compressed->size() : GetPositions().size();
+}
+
+bool Object::Intersect(const Vector3 & origin, const Vector3 & direction, Real & distance) const
+{
+	ArrayView<Vector3> positions = GetPositions();
+	const ArrayView<uint32_t> indices = GetIndices();
+
+	// picking is rare enough that decoding everything each time is fine
+	std::vector<Vector3> decompressed;
+
+	if (m_compressed)
+	{
+		decompressed.resize(m_compressed->size());
+
+		DecompressVertices(*m_compressed, 0, static_cast<uint32_t>(decompressed.size()),
+			decompressed.data(), nullptr);
+
+		positions = decompressed;
+	}
+
+	const std::size_t triangles = GetNumTriangles();
+
+	bool hit = false;
+
+	for (auto && instance : m_instances)
+	{
+		// take the ray into object space rather than every triangle into world
+		// space, w = 0 keeps the direction's length so distances still match
+		const Matrix4 inverse = instance.m_model.Inverse();
+
+		const Vector3 o = (inverse * Vector4(origin.x, origin.y, origin.z, 1.0)).XYZ();
+		const Vector3 d = (inverse * Vector4(direction.x, direction.y, direction.z, 0.0)).XYZ();
+
+		for (std::size_t i = 0; i < triangles; ++i)
+		{
+			// http://www.graphics.cornell.edu/pubs/1997/MT97.pdf
+
+			const Vector3 & p0 = positions[indices[i * 3]];
+			const Vector3 & p1 = positions[indices[i * 3 + 1]];
+			const Vector3 & p2 = positions[indices[i * 3 + 2]];
+
+			const Vector3 e1 = p1 - p0;
+			const Vector3 e2 = p2 - p0;
+
+			const Vector3 p = d.Cross(e2);
+			const Real determinant = e1.Dot(p);
+
+			// both sides are hit, picking shouldn't depend on the cull mode
+			if (std::fabs(determinant) < 1e-12f)
+				continue;
+
+			const Real inverseDeterminant = 1.0f / determinant;
+
+			const Vector3 s = o - p0;
+			const Real u = s.Dot(p) * inverseDeterminant;
+
+			if (u < 0.0f || u > 1.0f)
+				continue;
+
+			const Vector3 q = s.Cross(e1);
+			const Real v = d.Dot(q) * inverseDeterminant;
+
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+
+			const Real t = e2.Dot(q) * inverseDeterminant;
+
+			if (t > 0.0f && (!hit || t < distance))
+			{
+				distance = t;
+				hit = true;
+			}
+		}
+	}
+
+	return hit;
+}
+
+LevelOfDetail Object::GetLod(std::size_t level) const
+{
+	assert(level < GetNumLods());
+
+	if (level == 0)
+		return { GetIndices(), GetFacePlanes(), 0.0f };
+
+	if (m_external)
+		return m_external->m_lods[level - 1];
+
+	const LodBuffers & lod = m_lods[level - 1];
+
+	return { lod.m_indices, lod.m_facePlanes, lod.m_error };
+}
+
+void Object::GenerateLods()
+{
+	// below this the saving isn't worth another index buffer
+	const std::size_t MinTriangles = 64;
+
+	assert(! m_external && ! m_compressed);
+
+	m_lods.clear();
+
+	ArrayView<uint32_t> previous = m_indices;
+	Real previousError = 0.0f;
+
+	while (m_lods.size() + 1 < MaxLods)
+	{
+		const std::size_t triangles = previous.size() / 3;
+		const std::size_t target = triangles / 2;
+
+		if (target < MinTriangles)
+			break;
+
+		// simplifying the previous level rather than the original is much
+		// quicker, the errors add up so the total is still an upper bound
+		Real error;
+		std::vector<uint32_t> indices = SimplifyMesh(m_positions, m_normals, previous, target, error);
+
+		if (indices.size() / 3 > triangles - triangles / 10)
+			break;
+
+		OptimiseVertexCache(indices, m_positions.size());
+
+		LodBuffers lod;
+		lod.m_facePlanes = ComputeFacePlanes(m_positions, indices);
+		lod.m_indices = std::move(indices);
+		lod.m_error = previousError + error;
+
+		m_lods.push_back(std::move(lod));
+
+		previous = m_lods.back().m_indices;
+		previousError = m_lods.back().m_error;
+	}
+
+	++m_version;
+}
+
+void Object::CompressVertices()
+{
+	if (m_compressed)
+		return;
+
+	m_compressed = std::make_shared<CompressedVertices>(geometry::CompressVertices(GetPositions(), GetNormals()));
+
+	// external buffers stay mapped but are never touched again
+	std::vector<Vector3>().swap(m_positions);
+	std::vector<Vector3>().swap(m_normals);
+
+	++m_version;
+}
+
+void Object::BuffersChanged()
+{
+	m_external.reset();
+	m_compressed.reset();
+	m_lods.clear();
+
+	BuildFacePlanes();
+	BuildBounds();
+	TransformBounds();
+
+	++m_version;
+}
+
+void Object::UseExternalBuffers(std::shared_ptr<const ExternalBuffers> buffers)
+{
+	m_positions.clear();
+	m_normals.clear();
+	m_indices.clear();
+	m_facePlanes.clear();
+	m_lods.clear();
+	m_compressed.reset();
+
+	m_external = std::move(buffers);
+
+	m_box = m_external->m_box;
+	m_sphere = m_external->m_sphere;
+
+	TransformBounds();
+
+	++m_version;
+}
+
+void Object::BuildFacePlanes()
+{
+	m_facePlanes = ComputeFacePlanes(m_positions, m_indices);
+}
+
+void Object::BuildBounds()
+{
+	if (m_positions.empty())
+	{
+		m_box = {};
+		m_sphere = {};
+		return;
+	}
+
+	simd::ComputeBounds(m_positions.data(), m_positions.size(), m_box.m_min, m_box.m_max);
+
+	// centring the sphere on the box isn't the tightest fit but it only
+	// needs a single pass over the vertices
+	Vector3 centre = (m_box.m_min + m_box.m_max) * 0.5f;
+	Real radius = 0.0f;
+
+	for (auto && position : m_positions)
+		radius = std::max(radius, (position - centre).Length());
+
+	m_sphere = { centre, radius };
+}
+
+void Object::TransformBounds(Instance & instance) const
+{
+	const Matrix4 & model = instance.m_model;
+
+	const Real box_min[3] = { m_box.m_min.x, m_box.m_min.y, m_box.m_min.z };
+	const Real box_max[3] = { m_box.m_max.x, m_box.m_max.y, m_box.m_max.z };
+
+	Real world_min[3];
+	Real world_max[3];
+
+	// Arvo's method, each axis of the transformed box is the translation
+	// plus the extremes that each column of the rotation/scale can add
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		world_min[i] = world_max[i] = model(i, 3);
+
+		for (unsigned j = 0; j < 3; ++j)
+		{
+			const Real a = model(i, j) * box_min[j];
+			const Real b = model(i, j) * box_max[j];
+
+			world_min[i] += std::min(a, b);
+			world_max[i] += std::max(a, b);
+		}
+	}
+
+	instance.m_worldBox = {
+		{ world_min[0], world_min[1], world_min[2] },
+		{ world_max[0], world_max[1], world_max[2] },
+	};
+
+	// the radius grows with the largest scale along any axis
+	Real scale = 0.0f;
+
+	for (unsigned j = 0; j < 3; ++j)
+	{
+		const Vector3 column = { model(0, j), model(1, j), model(2, j) };
+
+		scale = std::max(scale, column.Length());
+	}
+
+	instance.m_worldSphere = { model * m_sphere.m_centre, m_sphere.m_radius * scale };
+}
+
+void Object::TransformBounds()
+{
+	for (auto && instance : m_instances)
+		TransformBounds(instance);
+
+	m_mergeBounds = true;
+}
+
+void Object::MergeInstanceBounds() const
+{
+	if (! m_mergeBounds)
+		return;
+
+	m_mergeBounds = false;
+
+	m_worldBox = m_instances[0].m_worldBox;
+	m_worldSphere = m_instances[0].m_worldSphere;
+
+	if (m_instances.size() == 1)
+		return;
+
+	for (auto && instance : m_instances)
+	{
+		m_worldBox.m_min.x = std::min(m_worldBox.m_min.x, instance.m_worldBox.m_min.x);
+		m_worldBox.m_min.y = std::min(m_worldBox.m_min.y, instance.m_worldBox.m_min.y);
+		m_worldBox.m_min.z = std::min(m_worldBox.m_min.z, instance.m_worldBox.m_min.z);
+		m_worldBox.m_max.x = std::max(m_worldBox.m_max.x, instance.m_worldBox.m_max.x);
+		m_worldBox.m_max.y = std::max(m_worldBox.m_max.y, instance.m_worldBox.m_max.y);
+		m_worldBox.m_max.z = std::max(m_worldBox.m_max.z, instance.m_worldBox.m_max.z);
+	}
+
+	// as with a single mesh the sphere is centred on the box
+	const Vector3 centre = (m_worldBox.m_min + m_worldBox.m_max) * 0.5f;
+	Real radius = 0.0f;
+
+	for (auto && instance : m_instances)
+		radius = std::max(radius, (instance.m_worldSphere.m_centre - centre).Length() + instance.m_worldSphere.m_radius);
+
+	m_worldSphere = { centre, radius };
+}
+
+}
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <vector>
+#include "AlignedAllocator.h"
+#include "ArrayView.h"
+#include "Colour.h"
 #include "Matrix.h"
 #include "ShaderCache.h"
 #include "Vector.h"
@@ -9,6 +16,8 @@
 namespace geometry
 {
 
+struct CompressedVertices;
+
 class Triangle
 {
 public:
@@ -68,6 +77,67 @@ public:
 	}
 };
 
+// Plane of a triangle in object space, a point p is in front of the triangle
+// when m_normal.Dot(p) > m_distance
+struct FacePlane
+{
+	Vector3 m_normal;
+	Real m_distance;
+};
+
+// One plane per triangle of an indexed mesh
+std::vector<FacePlane> ComputeFacePlanes(ArrayView<Vector3> positions, ArrayView<uint32_t> indices);
+
+struct BoundingSphere
+{
+	Vector3 m_centre;
+	Real m_radius;
+};
+
+struct BoundingBox
+{
+	Vector3 m_min;
+	Vector3 m_max;
+};
+
+// A level of detail draws a simplified set of triangles over the same
+// vertices as the full mesh
+struct LevelOfDetail
+{
+	ArrayView<uint32_t> m_indices;
+	ArrayView<FacePlane> m_facePlanes;
+
+	// how far the simplified surface can be from the original, in object
+	// space units
+	Real m_error;
+};
+
+// Buffers that live outside the object, e.g. in a mapped file. m_owner
+// keeps that memory alive for as long as any object uses it.
+struct ExternalBuffers
+{
+	ArrayView<Vector3> m_positions;
+	ArrayView<Vector3> m_normals;
+	ArrayView<uint32_t> m_indices;
+	ArrayView<FacePlane> m_facePlanes;
+	std::vector<LevelOfDetail> m_lods;
+	BoundingBox m_box;
+	BoundingSphere m_sphere;
+	std::shared_ptr<const void> m_owner;
+};
+
+// One placement of an object's mesh, every instance of an object draws the
+// same buffers
+struct Instance
+{
+	Matrix4 m_model;
+	Colour m_colour;
+
+	// Bounds after m_model has been applied
+	BoundingSphere m_worldSphere;
+	BoundingBox m_worldBox;
+};
+
 struct RenderPass
 {
 	bool m_reverseCull = false;
@@ -78,35 +148,136 @@ struct RenderPass
 class Object
 {	
 public:
+	// including the full mesh
+	static const std::size_t MaxLods = 8;
+
 	Object()
 		: m_passes(1)
+		, m_instances(1, Instance{ Matrix4::Identity, Colour::White })
 	{ }
-	const Matrix4 & GetModelMatrix() const { return m_model; }
-	void SetModelMatrix(const Matrix4 & model) { m_model = model; }
+
+	// The model matrix is the first instance's
+	const Matrix4 & GetModelMatrix() const { return m_instances[0].m_model; }
+	void SetModelMatrix(const Matrix4 & model) { SetInstanceModelMatrix(0, model); }
+
+	// Further instances draw the mesh again with their own model matrix and
+	// colour (which tints whatever the fragment shader outputs) without
+	// copying any buffers. Returns the index of the new instance.
+	std::size_t AddInstance(const Matrix4 & model, const Colour & colour = Colour::White);
+
+	// Leaves only the first instance
+	void RemoveInstances();
+
+	std::size_t GetNumInstances() const { return m_instances.size(); }
+	const Instance & GetInstance(std::size_t index) const { return m_instances[index]; }
+
+	void SetInstanceModelMatrix(std::size_t index, const Matrix4 & model);
+	void SetInstanceColour(std::size_t index, const Colour & colour) { m_instances[index].m_colour = colour; ++m_version; }
 
 	const std::size_t GetNumPasses() const { return m_passes.size(); }
 	const RenderPass & GetPass(std::size_t index) const { return m_passes[index]; }
-	void AddPass() { m_passes.resize(m_passes.size() + 1); }
+	void AddPass() { m_passes.resize(m_passes.size() + 1); ++m_version; }
 
 	bool ReverseCull(std::size_t index) const { return m_passes[index].m_reverseCull; }
-	void SetReverseCull(std::size_t index, bool reverse) { m_passes[index].m_reverseCull = reverse; }
+	void SetReverseCull(std::size_t index, bool reverse) { m_passes[index].m_reverseCull = reverse; ++m_version; }
 
 	ShadyObject * VertexShader(std::size_t index) const { return m_passes[index].m_vertexShader; }
-	void SetVertexShader(std::size_t index, ShadyObject * shader) { m_passes[index].m_vertexShader = shader; }
+	void SetVertexShader(std::size_t index, ShadyObject * shader) { m_passes[index].m_vertexShader = shader; ++m_version; }
 
 	ShadyObject * FragmentShader(std::size_t index) const { return m_passes[index].m_fragmentShader; }
-	void SetFragmentShader(std::size_t index, ShadyObject * shader) { m_passes[index].m_fragmentShader = shader; }
+	void SetFragmentShader(std::size_t index, ShadyObject * shader) { m_passes[index].m_fragmentShader = shader; ++m_version; }
+
+	// Goes up whenever anything that changes how the object is drawn does,
+	// so that a frame can tell which objects look the same as in the last
+	uint32_t GetVersion() const { return m_version; }
+
+	// Both are empty once the vertices have been compressed
+	ArrayView<Vector3> GetPositions() const { return m_compressed ? ArrayView<Vector3>() : m_external ? m_external->m_positions : m_positions; }
+	ArrayView<Vector3> GetNormals() const { return m_compressed ? ArrayView<Vector3>() : m_external ? m_external->m_normals : m_normals; }
+	ArrayView<uint32_t> GetIndices() const { return m_external ? m_external->m_indices : m_indices; }
 
-	const std::vector<Triangle> & GetTriangles() const
+	ArrayView<FacePlane> GetFacePlanes() const { return m_external ? m_external->m_facePlanes : m_facePlanes; }
+
+	// Bounds of the untransformed mesh
+	const BoundingSphere & GetBoundingSphere() const { return m_sphere; }
+	const BoundingBox & GetBoundingBox() const { return m_box; }
+
+	// Bounds after the model matrix has been applied, covering every instance
+	const BoundingSphere & GetWorldBoundingSphere() const { MergeInstanceBounds(); return m_worldSphere; }
+	const BoundingBox & GetWorldBoundingBox() const { MergeInstanceBounds(); return m_worldBox; }
+
+	std::size_t GetNumVertices() const;
+	std::size_t GetNumTriangles() const { return GetIndices().size() / 3; }
+
+	// Level 0 is the full mesh, each level after has about half the
+	// triangles of the one before
+	std::size_t GetNumLods() const { return 1 + (m_external ? m_external->m_lods.size() : m_lods.size()); }
+	LevelOfDetail GetLod(std::size_t level) const;
+
+	// Builds the chain of simplified levels, meshes too small to be worth
+	// simplifying get none
+	void GenerateLods();
+
+	// Replaces the float positions and normals with quantised streams that
+	// take 10 bytes a vertex rather than 24, see VertexCompression.h. Face
+	// planes, bounds and levels of detail are kept as they are so anything
+	// that needs the float buffers (e.g. GenerateLods) has to happen first.
+	void CompressVertices();
+
+	// Null unless CompressVertices has been called
+	const CompressedVertices * GetCompressedVertices() const { return m_compressed.get(); }
+
+	// Finds the nearest triangle of any instance hit by a world space ray,
+	// distance is measured in multiples of direction
+	bool Intersect(const Vector3 & origin, const Vector3 & direction, Real & distance) const;
+
+protected:
+	// Builds the vertex and index buffers from a triangle soup, sharing any
+	// corners that have identical positions and normals
+	void SetTriangles(const std::vector<Triangle> & triangles);
+
+	// Has to be called whenever the vertex or index buffers change
+	void BuffersChanged();
+
+	// Uses buffers (including precomputed face planes and bounds) from
+	// somewhere else in place of the object's own, nothing is copied
+	void UseExternalBuffers(std::shared_ptr<const ExternalBuffers> buffers);
+
+private:
+	struct LodBuffers
 	{
-		return m_triangles;
-	}
+		std::vector<uint32_t> m_indices;
+		std::vector<FacePlane> m_facePlanes;
+		Real m_error;
+	};
+
+	void BuildFacePlanes();
+	void BuildBounds();
+	void TransformBounds(Instance & instance) const;
+	void TransformBounds();
+	void MergeInstanceBounds() const;
 
 protected:
-	Matrix4 m_model = Matrix4::Identity;
-	std::vector<geometry::Triangle> m_triangles;
+	std::vector<Vector3> m_positions;
+	std::vector<Vector3> m_normals;
+	std::vector<uint32_t> m_indices;
+	std::vector<FacePlane> m_facePlanes;
+	std::vector<LodBuffers> m_lods;
+	std::shared_ptr<const ExternalBuffers> m_external;
+	std::shared_ptr<const CompressedVertices> m_compressed;
+	BoundingSphere m_sphere = {};
+	BoundingBox m_box = {};
 	bool m_reverseCull = false;
 	std::vector<RenderPass> m_passes;
+	AlignedVector<Instance> m_instances;
+
+	// the union of the instances' bounds, only worked out when it's asked
+	// for so that moving every instance isn't quadratic
+	mutable BoundingSphere m_worldSphere = {};
+	mutable BoundingBox m_worldBox = {};
+	mutable bool m_mergeBounds = true;
+
+	uint32_t m_version = 0;
 };
 
 class Cube
@@ -185,7 +356,7 @@ public:
 			}
 		}
 
-		m_triangles.insert(m_triangles.begin(), std::begin(faces), std::end(faces));
+		SetTriangles({ std::begin(faces), std::end(faces) });
 	}
 };
 
@@ -214,63 +385,91 @@ public:
 			{   -t,  0.0,  1.0 },
 		}};
 
-		std::vector<Triangle> faces =
+		m_positions.assign(points.begin(), points.end());
+
+		m_indices =
 		{
-			{ points[0], points[11], points[5] },
-			{ points[0], points[5], points[1] },
-			{ points[0], points[1], points[7] },
-			{ points[0], points[7], points[10] },
-			{ points[0], points[10], points[11] },
-			{ points[1], points[5], points[9] },
-			{ points[5], points[11], points[4] },
-			{ points[11], points[10], points[2] },
-			{ points[10], points[7], points[6] },
-			{ points[7], points[1], points[8] },
-			{ points[3], points[9], points[4] },
-			{ points[3], points[4], points[2] },
-			{ points[3], points[2], points[6] },
-			{ points[3], points[6], points[8] },
-			{ points[3], points[8], points[9] },
-			{ points[4], points[9], points[5] },
-			{ points[2], points[4], points[11] },
-			{ points[6], points[2], points[10] },
-			{ points[8], points[6], points[7] },
-			{ points[9], points[8], points[1] },
+			0, 11, 5,
+			0, 5, 1,
+			0, 1, 7,
+			0, 7, 10,
+			0, 10, 11,
+			1, 5, 9,
+			5, 11, 4,
+			11, 10, 2,
+			10, 7, 6,
+			7, 1, 8,
+			3, 9, 4,
+			3, 4, 2,
+			3, 2, 6,
+			3, 6, 8,
+			3, 8, 9,
+			4, 9, 5,
+			2, 4, 11,
+			6, 2, 10,
+			8, 6, 7,
+			9, 8, 1,
 		};
 
 		for (uint32_t i = 0; i < subdivision; ++i)
 		{
-			std::vector<Triangle> newFaces;
+			// Edges are shared by two faces so remember the midpoint that was
+			// made for each one
+			std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+
+			auto Midpoint = [&](uint32_t a, uint32_t b)
+			{
+				auto key = std::make_pair(std::min(a, b), std::max(a, b));
+				auto iter = midpoints.find(key);
+
+				if (iter != midpoints.end())
+					return iter->second;
+
+				const uint32_t index = static_cast<uint32_t>(m_positions.size());
+				m_positions.push_back(m_positions[a] + ((m_positions[b] - m_positions[a]) * 0.5));
+				midpoints.emplace(key, index);
+				return index;
+			};
 
-			for (auto && face : faces)
+			std::vector<uint32_t> newIndices;
+			newIndices.reserve(m_indices.size() * 4);
+
+			const std::size_t size = m_indices.size();
+
+			for (std::size_t face = 0; face < size; face += 3)
 			{
-				Vector3 mid1pos = face.points[0] + ((face.points[1] - face.points[0]) * 0.5);
-				Vector3 mid2pos = face.points[1] + ((face.points[2] - face.points[1]) * 0.5);
-				Vector3 mid3pos = face.points[2] + ((face.points[0] - face.points[2]) * 0.5);
-
-				newFaces.emplace_back(face.points[0], mid1pos, mid3pos);
-				newFaces.emplace_back(face.points[1], mid2pos, mid1pos);
-				newFaces.emplace_back(face.points[2], mid3pos, mid2pos);
-				newFaces.emplace_back(mid1pos, mid2pos, mid3pos);
+				const uint32_t p0 = m_indices[face];
+				const uint32_t p1 = m_indices[face + 1];
+				const uint32_t p2 = m_indices[face + 2];
+
+				const uint32_t mid1 = Midpoint(p0, p1);
+				const uint32_t mid2 = Midpoint(p1, p2);
+				const uint32_t mid3 = Midpoint(p2, p0);
+
+				newIndices.insert(newIndices.end(), { p0, mid1, mid3 });
+				newIndices.insert(newIndices.end(), { p1, mid2, mid1 });
+				newIndices.insert(newIndices.end(), { p2, mid3, mid2 });
+				newIndices.insert(newIndices.end(), { mid1, mid2, mid3 });
 			}
 
-			faces = std::move(newFaces);
+			m_indices = std::move(newIndices);
 		}
 
 		Real half = size / 2.0;
 
-		for (auto && face : faces)
+		m_normals.resize(m_positions.size());
+
+		const std::size_t vertices = m_positions.size();
+
+		for (std::size_t i = 0; i < vertices; ++i)
 		{
-			for (int i = 0; i < 3; ++i)
-			{
-				face.normals[i] = face.points[i].NormalizedCopy();
+			m_normals[i] = m_positions[i].NormalizedCopy();
 
-				Real l = face.points[i].Length();
-				face.points[i] = face.points[i] * (half / l);
-			}
+			Real l = m_positions[i].Length();
+			m_positions[i] = m_positions[i] * (half / l);
 		}
 
-		m_triangles.insert(m_triangles.begin(), faces.begin(), faces.end());
+		BuffersChanged();
 	}
 };
 
@@ -0,0 +1,83 @@
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+#include <Windows.h>
+#include "ImageWriter.h"
+
+ImageWriter::ImageWriter(const std::string & filename, unsigned width, unsigned height, PixelFormat format)
+	: m_file(filename, std::ios::binary | std::ios::trunc)
+	, m_width(width)
+	, m_height(height)
+	, m_format(format)
+	, m_float(pixels::IsFloat(format))
+{
+	if (! m_file.is_open())
+		throw std::runtime_error("could not open " + filename);
+
+	if (m_float)
+	{
+		// a negative scale means little endian, rows go bottom to top
+		char header[64];
+
+		const int length = std::snprintf(header, sizeof(header), "PF\n%u %u\n-1.0\n", width, height);
+
+		m_file.write(header, length);
+
+		m_headerSize = length;
+		m_bytesPerPixel = 3 * sizeof(float);
+	}
+	else
+	{
+		m_bytesPerPixel = sizeof(uint32_t);
+
+		BITMAPFILEHEADER file = {};
+		BITMAPINFOHEADER info = {};
+
+		m_headerSize = sizeof(file) + sizeof(info);
+
+		file.bfType = 'B' | ('M' << 8);
+		file.bfSize = static_cast<DWORD>(m_headerSize + std::streamoff(width) * height * m_bytesPerPixel);
+		file.bfOffBits = static_cast<DWORD>(m_headerSize);
+
+		info.biSize = sizeof(info);
+		info.biWidth = width;
+
+		// negative for rows top to bottom
+		info.biHeight = -static_cast<LONG>(height);
+		info.biPlanes = 1;
+		info.biBitCount = 32;
+		info.biCompression = BI_RGB;
+
+		m_file.write(reinterpret_cast<const char *>(&file), sizeof(file));
+		m_file.write(reinterpret_cast<const char *>(&info), sizeof(info));
+	}
+}
+
+void ImageWriter::Write(unsigned x, unsigned y, const unsigned char * values, unsigned count)
+{
+	assert(x + count <= m_width && y < m_height);
+
+	const char * bytes;
+
+	if (m_float)
+	{
+		m_rgb.resize(count * 3);
+		pixels::ToRGB(m_format, values, m_rgb.data(), count);
+
+		bytes = reinterpret_cast<const char *>(m_rgb.data());
+		y = m_height - 1 - y;
+	}
+	else
+	{
+		m_display.resize(count);
+		pixels::ToDisplay(m_format, values, m_display.data(), count);
+
+		bytes = reinterpret_cast<const char *>(m_display.data());
+	}
+
+	m_file.seekp(m_headerSize + (std::streamoff(y) * m_width + x) * m_bytesPerPixel);
+	m_file.write(bytes, std::streamsize(count) * m_bytesPerPixel);
+
+	if (! m_file.good())
+		throw std::runtime_error("could not write the image");
+}
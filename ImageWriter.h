@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "PixelFormat.h"
+
+// Saves an image that is finished a piece at a time, in any order. Every
+// row has a fixed place in the file so pieces are written out as they come
+// and none of the image is kept.
+//
+// Float formats are saved as a PFM so that values over 1 survive, anything
+// else as a 32 bit BMP.
+class ImageWriter
+{
+public:
+	ImageWriter(const std::string & filename, unsigned width, unsigned height, PixelFormat format);
+
+	// count pixels in the writer's format, from column x of row y. Isn't
+	// safe to call from more than one thread at once.
+	void Write(unsigned x, unsigned y, const unsigned char * values, unsigned count);
+
+private:
+	std::ofstream m_file;
+
+	unsigned m_width;
+	unsigned m_height;
+	PixelFormat m_format;
+	bool m_float;
+
+	std::streamoff m_headerSize;
+	unsigned m_bytesPerPixel;
+
+	// the pixels converted for the file
+	std::vector<uint32_t> m_display;
+	std::vector<float> m_rgb;
+};
@@ -0,0 +1,203 @@
+#include <cassert>
+#include "JobSystem.h"
+
+namespace
+{
+	thread_local unsigned t_threadIndex = 0;
+}
+
+JobSystem & JobSystem::Get()
+{
+	static JobSystem instance;
+	return instance;
+}
+
+JobSystem::JobSystem()
+	: m_queued(0)
+{
+	const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < threads; ++i)
+		m_queues.emplace_back(new Queue);
+
+	// the main thread is 0 and works while it waits
+	for (unsigned i = 1; i < threads; ++i)
+		m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+
+	m_wake.notify_all();
+
+	for (auto && worker : m_workers)
+		worker.join();
+}
+
+unsigned JobSystem::GetThreadIndex()
+{
+	return t_threadIndex;
+}
+
+void JobSystem::Submit(PendingJob * job, JobCounter * dependency)
+{
+	if (job->m_counter)
+		job->m_counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+
+	if (dependency)
+	{
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+
+		// the last job to finish counts down with the lock held so either it
+		// will see this job or the count is already zero here
+		if (! dependency->IsDone())
+		{
+			job->m_next = dependency->m_waiting;
+			dependency->m_waiting = job;
+			return;
+		}
+	}
+
+	Push(job);
+}
+
+void JobSystem::Wait(JobCounter & counter)
+{
+	const unsigned thread = GetThreadIndex();
+
+	while (! counter.IsDone())
+	{
+		if (! TryRun(thread))
+			std::this_thread::yield();
+	}
+
+	// the last job may still hold the lock it counted down under, the
+	// counter mustn't go away until it has let go
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::Push(PendingJob * job)
+{
+	Queue & queue = *m_queues[GetThreadIndex()];
+
+	{
+		std::lock_guard<std::mutex> lock(queue.m_mutex);
+
+		job->m_previous = queue.m_back;
+		job->m_next = nullptr;
+
+		if (queue.m_back)
+			queue.m_back->m_next = job;
+		else
+			queue.m_front = job;
+
+		queue.m_back = job;
+	}
+
+	m_queued.fetch_add(1, std::memory_order_release);
+
+	// taking the lock means a worker can't be between checking m_queued and
+	// going to sleep, so the notification isn't lost
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+
+	m_wake.notify_one();
+}
+
+bool JobSystem::TryRun(unsigned thread)
+{
+	PendingJob * job = nullptr;
+
+	{
+		Queue & own = *m_queues[thread];
+		std::lock_guard<std::mutex> lock(own.m_mutex);
+
+		if (own.m_back)
+		{
+			job = own.m_back;
+			own.m_back = job->m_previous;
+
+			if (own.m_back)
+				own.m_back->m_next = nullptr;
+			else
+				own.m_front = nullptr;
+		}
+	}
+
+	// starting from the next thread along spreads the thieves out
+	for (std::size_t i = 1; i < m_queues.size() && ! job; ++i)
+	{
+		Queue & other = *m_queues[(thread + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(other.m_mutex);
+
+		if (other.m_front)
+		{
+			job = other.m_front;
+			other.m_front = job->m_next;
+
+			if (other.m_front)
+				other.m_front->m_previous = nullptr;
+			else
+				other.m_back = nullptr;
+		}
+	}
+
+	if (! job)
+		return false;
+
+	m_queued.fetch_sub(1, std::memory_order_relaxed);
+
+	job->m_run(job->m_function);
+
+	Finished(job->m_counter);
+
+	return true;
+}
+
+void JobSystem::Finished(JobCounter * counter)
+{
+	if (! counter)
+		return;
+
+	PendingJob * released = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+
+		if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			std::swap(released, counter->m_waiting);
+	}
+
+	// pushing a job reuses its links for the queue
+	while (released)
+	{
+		PendingJob * next = released->m_next;
+
+		Push(released);
+
+		released = next;
+	}
+}
+
+void JobSystem::WorkerLoop(unsigned thread)
+{
+	t_threadIndex = thread;
+
+	while (true)
+	{
+		if (TryRun(thread))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+
+		m_wake.wait(lock, [this]() { return m_quit || m_queued.load(std::memory_order_acquire) > 0; });
+
+		if (m_quit)
+			return;
+	}
+}
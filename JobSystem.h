@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "FrameArena.h"
+
+class JobCounter;
+
+// A job and the counter to count down once it has run. Both it and the
+// function it runs are put in the frame arena of the thread that queued it,
+// so queueing a job never touches the heap.
+struct PendingJob
+{
+	// calls the function and then destroys it
+	void (*m_run)(void * function);
+	void * m_function;
+
+	JobCounter * m_counter;
+
+	// a job is either waiting on a counter or in a queue, the links are for
+	// whichever list it's in
+	PendingJob * m_previous;
+	PendingJob * m_next;
+};
+
+// Counts jobs that haven't finished. Other jobs can be made to wait for it to
+// reach zero and any thread can Wait on it, which is also what makes it safe
+// to destroy.
+class JobCounter
+{
+public:
+	JobCounter()
+		: m_pending(0)
+	{ }
+
+	JobCounter(const JobCounter &) = delete;
+	JobCounter & operator=(const JobCounter &) = delete;
+
+	bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<unsigned> m_pending;
+
+	// jobs that depend on this counter, released when it reaches zero
+	std::mutex m_mutex;
+	PendingJob * m_waiting = nullptr;
+};
+
+// A worker thread per core besides the main thread. Each thread has its own
+// queue and takes its newest job first, which is the one most likely to still
+// be in cache. Once a queue is empty its thread steals the oldest job from
+// another, which tends to be a big piece of work that hasn't been split yet.
+class JobSystem
+{
+public:
+	static JobSystem & Get();
+
+	JobSystem();
+	~JobSystem();
+
+	JobSystem(const JobSystem &) = delete;
+	JobSystem & operator=(const JobSystem &) = delete;
+
+	// Threads that can run jobs, including the main thread
+	unsigned GetNumThreads() const { return static_cast<unsigned>(m_queues.size()); }
+
+	// Which of them is calling, 0 for the main thread (or any thread that
+	// isn't a worker). A job runs start to finish on one thread so this can
+	// pick per thread state.
+	static unsigned GetThreadIndex();
+
+	// counter (if any) counts the job until it has run, it won't start until
+	// dependency (if any) is done. The job is kept in the frame arena so it
+	// has to have run before the arena is reset.
+	template <typename Function>
+	void Run(Function job, JobCounter * counter = nullptr, JobCounter * dependency = nullptr)
+	{
+		FrameArena & arena = FrameArena::Get();
+
+		PendingJob * pending = arena.Allocate<PendingJob>(1);
+
+		pending->m_run = &RunAndDestroy<Function>;
+		pending->m_function = new (arena.Allocate<Function>(1)) Function(std::move(job));
+		pending->m_counter = counter;
+		pending->m_previous = nullptr;
+		pending->m_next = nullptr;
+
+		Submit(pending, dependency);
+	}
+
+	// Runs jobs on the calling thread until the counter is done
+	void Wait(JobCounter & counter);
+
+	// Calls function(begin, end) over disjoint ranges that cover [0, count),
+	// none smaller than grain unless count is, and returns when all are done
+	template <typename Function>
+	void ParallelFor(std::size_t count, std::size_t grain, const Function & function)
+	{
+		// a few ranges per thread so that a slow one doesn't hold up the rest
+		const std::size_t ranges = std::max<std::size_t>(1,
+			std::min<std::size_t>(count / std::max<std::size_t>(grain, 1), GetNumThreads() * 4));
+
+		if (ranges == 1)
+		{
+			if (count > 0)
+				function(0, count);
+
+			return;
+		}
+
+		JobCounter counter;
+
+		for (std::size_t i = 1; i < ranges; ++i)
+			Run([&function, count, ranges, i]() { function(count * i / ranges, count * (i + 1) / ranges); }, &counter);
+
+		function(0, count / ranges);
+
+		Wait(counter);
+	}
+
+private:
+	template <typename Function>
+	static void RunAndDestroy(void * function)
+	{
+		Function & job = *static_cast<Function*>(function);
+
+		job();
+		job.~Function();
+	}
+
+	// The owner takes from the back and thieves from the front
+	struct Queue
+	{
+		std::mutex m_mutex;
+		PendingJob * m_front = nullptr;
+		PendingJob * m_back = nullptr;
+	};
+
+	void Submit(PendingJob * job, JobCounter * dependency);
+	void Push(PendingJob * job);
+	bool TryRun(unsigned thread);
+	void Finished(JobCounter * counter);
+	void WorkerLoop(unsigned thread);
+
+private:
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_workers;
+
+	// workers sleep while there's nothing queued anywhere
+	std::atomic<unsigned> m_queued;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	bool m_quit = false;
+};
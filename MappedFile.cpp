@@ -0,0 +1,54 @@
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::string & filename)
+{
+	m_file = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (m_file == INVALID_HANDLE_VALUE)
+		return;
+
+	LARGE_INTEGER size;
+
+	if (! GetFileSizeEx(m_file, &size))
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+		return;
+	}
+
+	m_size = static_cast<std::size_t>(size.QuadPart);
+
+	// an empty file can't be mapped but is still a valid file
+	if (m_size == 0)
+		return;
+
+	m_mapping = CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (m_mapping)
+		m_data = static_cast<const char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+
+	if (! m_data)
+	{
+		if (m_mapping)
+			CloseHandle(m_mapping);
+
+		CloseHandle(m_file);
+
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+		m_size = 0;
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+
+	if (m_mapping)
+		CloseHandle(m_mapping);
+
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <Windows.h>
+
+// Read-only view of a whole file, the pages are only read in as they are
+// touched
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string & filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	bool IsOpen() const { return m_file != INVALID_HANDLE_VALUE; }
+
+	const char * GetData() const { return m_data; }
+	std::size_t GetSize() const { return m_size; }
+
+private:
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+	const char * m_data = nullptr;
+	std::size_t m_size = 0;
+};
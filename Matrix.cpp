@@ -1,3 +1,4 @@
+#include <cmath>
 #include "Matrix.h"
 
 const Matrix4 Matrix4::Identity {{{
@@ -6,3 +7,67 @@ const Matrix4 Matrix4::Identity {{{
 	{ 0.0, 0.0, 1.0, 0.0 },
 	{ 0.0, 0.0, 0.0, 1.0 }
 }}};
+
+Matrix4 Matrix4::Inverse() const
+{
+	// Inverse by cofactors, the 2x2 determinants of the top and bottom two
+	// rows are shared between the cofactors
+	const Real (&m)[4][4] = m_values;
+
+	const Real s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+	const Real s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+	const Real s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+	const Real s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+	const Real s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+	const Real s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+
+	const Real c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+	const Real c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+	const Real c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+	const Real c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+	const Real c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+	const Real c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+
+	const Real determinant = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+
+	assert(std::abs(determinant) > 0.0f);
+
+	const Real invdet = 1.0f / determinant;
+
+	Matrix4 out;
+	Real (&o)[4][4] = out.m_values;
+
+	o[0][0] = ( m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * invdet;
+	o[0][1] = (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * invdet;
+	o[0][2] = ( m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * invdet;
+	o[0][3] = (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * invdet;
+
+	o[1][0] = (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * invdet;
+	o[1][1] = ( m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * invdet;
+	o[1][2] = (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * invdet;
+	o[1][3] = ( m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * invdet;
+
+	o[2][0] = ( m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * invdet;
+	o[2][1] = (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * invdet;
+	o[2][2] = ( m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * invdet;
+	o[2][3] = (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * invdet;
+
+	o[3][0] = (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * invdet;
+	o[3][1] = ( m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * invdet;
+	o[3][2] = (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * invdet;
+	o[3][3] = ( m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * invdet;
+
+	return out;
+}
+
+Matrix4 Matrix4::NormalMatrix() const
+{
+	const Matrix4 m = Inverse().Transpose();
+
+	return {{{
+		{ m(0, 0), m(0, 1), m(0, 2), 0.0 },
+		{ m(1, 0), m(1, 1), m(1, 2), 0.0 },
+		{ m(2, 0), m(2, 1), m(2, 2), 0.0 },
+		{ 0.0,     0.0,     0.0,     1.0 }
+	}}};
+}
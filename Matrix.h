@@ -2,6 +2,7 @@
 
 #include <array>
 #include <cassert>
+#include <xmmintrin.h>
 #include "Types.h"
 #include "Vector.h"
 
@@ -63,15 +64,20 @@ public:
 	{
 		Matrix4 m;
 
+		const __m128 r0 = _mm_loadu_ps(rhs.m_values[0]);
+		const __m128 r1 = _mm_loadu_ps(rhs.m_values[1]);
+		const __m128 r2 = _mm_loadu_ps(rhs.m_values[2]);
+		const __m128 r3 = _mm_loadu_ps(rhs.m_values[3]);
+
+		// each row of the result is the rows of rhs weighted by the same row
+		// of this matrix
 		for (int i = 0; i < 4; ++i)
 		{
-			for (int j = 0; j < 4; ++j)
-			{
-				for (int k = 0; k < 4; k++)
-				{
-					m.m_values[i][j] += m_values[i][k] * rhs.m_values[k][j];
-				}
-			}
+			const __m128 row = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_values[i][0]), r0), _mm_mul_ps(_mm_set1_ps(m_values[i][1]), r1)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m_values[i][2]), r2), _mm_mul_ps(_mm_set1_ps(m_values[i][3]), r3)));
+
+			_mm_storeu_ps(m.m_values[i], row);
 		}
 
 		return m;
@@ -79,12 +85,17 @@ public:
 
 	Vector4 operator*(const Vector4 & rhs) const
 	{
-		return {
-			m_values[0][0] * rhs.x + m_values[0][1] * rhs.y + m_values[0][2] * rhs.z + m_values[0][3] * rhs.w,
-			m_values[1][0] * rhs.x + m_values[1][1] * rhs.y + m_values[1][2] * rhs.z + m_values[1][3] * rhs.w,
-			m_values[2][0] * rhs.x + m_values[2][1] * rhs.y + m_values[2][2] * rhs.z + m_values[2][3] * rhs.w,
-			m_values[3][0] * rhs.x + m_values[3][1] * rhs.y + m_values[3][2] * rhs.z + m_values[3][3] * rhs.w,
-		};
+		const __m128 v = rhs.Load();
+
+		__m128 p0 = _mm_mul_ps(_mm_loadu_ps(m_values[0]), v);
+		__m128 p1 = _mm_mul_ps(_mm_loadu_ps(m_values[1]), v);
+		__m128 p2 = _mm_mul_ps(_mm_loadu_ps(m_values[2]), v);
+		__m128 p3 = _mm_mul_ps(_mm_loadu_ps(m_values[3]), v);
+
+		// after transposing, adding the four registers sums each row's products
+		_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+
+		return Vector4::FromRegister(_mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
 	}
 
 	Vector3 operator*(const Vector3 & rhs) const
@@ -95,6 +106,43 @@ public:
 		return { v4.x / v4.w, v4.y / v4.w, v4.z / v4.w };
 	}
 
+	Real operator()(unsigned row, unsigned column) const
+	{
+		return m_values[row][column];
+	}
+
+	// All sixteen values, a row at a time
+	const Real * Data() const
+	{
+		return &m_values[0][0];
+	}
+
+	Matrix4 Inverse() const;
+
+	Matrix4 Transpose() const
+	{
+		Matrix4 m;
+
+		__m128 r0 = _mm_loadu_ps(m_values[0]);
+		__m128 r1 = _mm_loadu_ps(m_values[1]);
+		__m128 r2 = _mm_loadu_ps(m_values[2]);
+		__m128 r3 = _mm_loadu_ps(m_values[3]);
+
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		_mm_storeu_ps(m.m_values[0], r0);
+		_mm_storeu_ps(m.m_values[1], r1);
+		_mm_storeu_ps(m.m_values[2], r2);
+		_mm_storeu_ps(m.m_values[3], r3);
+
+		return m;
+	}
+
+	// The inverse-transpose of the top left 3x3, which takes normals along
+	// with this matrix even when it scales unevenly. The rest is identity so
+	// that w (0 for a normal) stays out of any later normalize.
+	Matrix4 NormalMatrix() const;
+
 	static Matrix4 Translation(const Vector3 & rhs)
 	{
 		return {{{
@@ -167,6 +215,7 @@ public:
 	static const Matrix4 Identity;
 
 private:
-	Real m_values[4][4];
+	// one row per SSE register, see Vector4 about alignment on the heap
+	alignas(16) Real m_values[4][4];
 };
 
@@ -0,0 +1,263 @@
+#include <cstring>
+#include <fstream>
+#include <Windows.h>
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "ObjReader.h"
+
+namespace
+{
+	const char Magic[4] = { 'B', 'R', 'M', 'C' };
+	// 3: levels of detail keep the mesh's normal seams
+	// 4: level of detail errors are distances to faces, not means
+	const uint32_t Version = 4;
+
+	const uint64_t Alignment = 64;
+	const uint32_t MaxLods = geometry::Object::MaxLods;
+
+	// the streams are written straight from memory so the layout of these
+	// is part of the format
+	static_assert(sizeof(Vector3) == 12, "Vector3 has to be three packed floats");
+	static_assert(sizeof(geometry::FacePlane) == 16, "FacePlane has to be four packed floats");
+
+	struct Section
+	{
+		uint64_t m_offset;
+		uint64_t m_count;
+	};
+
+	struct LodSections
+	{
+		Section m_indices;
+		Section m_facePlanes;
+		Real m_error;
+		uint32_t m_padding;
+	};
+
+	struct Header
+	{
+		char m_magic[4];
+		uint32_t m_version;
+		uint32_t m_vertexCount;
+		uint32_t m_lodCount;
+		geometry::BoundingBox m_box;
+		geometry::BoundingSphere m_sphere;
+		Section m_positions;
+		Section m_normals;
+		LodSections m_lods[MaxLods];
+	};
+
+	uint64_t Align(uint64_t offset)
+	{
+		return (offset + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	template <typename T>
+	bool SectionFits(const Section & section, std::size_t fileSize)
+	{
+		return section.m_offset % Alignment == 0 &&
+			section.m_offset <= fileSize &&
+			section.m_count <= (fileSize - section.m_offset) / sizeof(T);
+	}
+
+	template <typename T>
+	ArrayView<T> SectionView(const char * data, const Section & section)
+	{
+		return { reinterpret_cast<const T *>(data + section.m_offset), static_cast<std::size_t>(section.m_count) };
+	}
+
+	bool IsNewer(const std::string & filename, const std::string & than)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA file;
+		WIN32_FILE_ATTRIBUTE_DATA other;
+
+		if (! GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &file))
+			return false;
+
+		if (! GetFileAttributesEx(than.c_str(), GetFileExInfoStandard, &other))
+			return true;
+
+		return CompareFileTime(&file.ftLastWriteTime, &other.ftLastWriteTime) > 0;
+	}
+
+	class CachedModel
+		: public geometry::Object
+	{
+	public:
+		explicit CachedModel(std::shared_ptr<const geometry::ExternalBuffers> buffers)
+		{
+			UseExternalBuffers(std::move(buffers));
+		}
+	};
+}
+
+bool MeshCache::Write(const std::string & filename, const geometry::Object & object)
+{
+	// the cache holds float vertices, it's written before anything is compressed
+	if (object.GetCompressedVertices())
+		return false;
+
+	const ArrayView<Vector3> positions = object.GetPositions();
+	const ArrayView<Vector3> normals = object.GetNormals();
+
+	Header header = {};
+
+	std::memcpy(header.m_magic, Magic, sizeof(Magic));
+	header.m_version = Version;
+	header.m_vertexCount = static_cast<uint32_t>(positions.size());
+	header.m_lodCount = static_cast<uint32_t>(object.GetNumLods());
+	header.m_box = object.GetBoundingBox();
+	header.m_sphere = object.GetBoundingSphere();
+
+	uint64_t offset = Align(sizeof(Header));
+
+	auto Place = [&offset](Section & section, std::size_t count, std::size_t size)
+	{
+		section.m_offset = offset;
+		section.m_count = count;
+		offset = Align(offset + count * size);
+	};
+
+	Place(header.m_positions, positions.size(), sizeof(Vector3));
+	Place(header.m_normals, normals.size(), sizeof(Vector3));
+
+	for (uint32_t i = 0; i < header.m_lodCount; ++i)
+	{
+		const geometry::LevelOfDetail lod = object.GetLod(i);
+
+		Place(header.m_lods[i].m_indices, lod.m_indices.size(), sizeof(uint32_t));
+		Place(header.m_lods[i].m_facePlanes, lod.m_facePlanes.size(), sizeof(geometry::FacePlane));
+		header.m_lods[i].m_error = lod.m_error;
+	}
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+
+	if (! file.good())
+		return false;
+
+	uint64_t written = 0;
+
+	auto WriteAt = [&](const Section & section, const void * data, std::size_t size)
+	{
+		static const char padding[Alignment] = {};
+
+		file.write(padding, static_cast<std::streamsize>(section.m_offset - written));
+		file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+
+		written = section.m_offset + size;
+	};
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	written = sizeof(header);
+
+	WriteAt(header.m_positions, positions.data(), positions.size() * sizeof(Vector3));
+	WriteAt(header.m_normals, normals.data(), normals.size() * sizeof(Vector3));
+
+	for (uint32_t i = 0; i < header.m_lodCount; ++i)
+	{
+		const geometry::LevelOfDetail lod = object.GetLod(i);
+
+		WriteAt(header.m_lods[i].m_indices, lod.m_indices.data(), lod.m_indices.size() * sizeof(uint32_t));
+		WriteAt(header.m_lods[i].m_facePlanes, lod.m_facePlanes.data(), lod.m_facePlanes.size() * sizeof(geometry::FacePlane));
+	}
+
+	return file.good();
+}
+
+std::unique_ptr<geometry::Object> MeshCache::Read(const std::string & filename)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(filename);
+
+	if (! file->IsOpen() || file->GetSize() < sizeof(Header))
+		return nullptr;
+
+	const char * data = file->GetData();
+	const std::size_t size = file->GetSize();
+
+	Header header;
+	std::memcpy(&header, data, sizeof(header));
+
+	if (std::memcmp(header.m_magic, Magic, sizeof(Magic)) != 0 || header.m_version != Version)
+		return nullptr;
+
+	if (header.m_lodCount == 0 || header.m_lodCount > MaxLods)
+		return nullptr;
+
+	if (! SectionFits<Vector3>(header.m_positions, size) ||
+		! SectionFits<Vector3>(header.m_normals, size) ||
+		header.m_positions.m_count != header.m_vertexCount ||
+		header.m_normals.m_count != header.m_vertexCount)
+	{
+		return nullptr;
+	}
+
+	for (uint32_t i = 0; i < header.m_lodCount; ++i)
+	{
+		const LodSections & lod = header.m_lods[i];
+
+		if (! SectionFits<uint32_t>(lod.m_indices, size) ||
+			! SectionFits<geometry::FacePlane>(lod.m_facePlanes, size) ||
+			lod.m_facePlanes.m_count * 3 != lod.m_indices.m_count)
+		{
+			return nullptr;
+		}
+
+		// drawing trusts the indices, one past the vertices would read
+		// outside the mapped file
+		const ArrayView<uint32_t> indices = SectionView<uint32_t>(data, lod.m_indices);
+
+		for (uint32_t index : indices)
+		{
+			if (index >= header.m_vertexCount)
+				return nullptr;
+		}
+	}
+
+	std::shared_ptr<geometry::ExternalBuffers> buffers = std::make_shared<geometry::ExternalBuffers>();
+
+	buffers->m_positions = SectionView<Vector3>(data, header.m_positions);
+	buffers->m_normals = SectionView<Vector3>(data, header.m_normals);
+	buffers->m_indices = SectionView<uint32_t>(data, header.m_lods[0].m_indices);
+	buffers->m_facePlanes = SectionView<geometry::FacePlane>(data, header.m_lods[0].m_facePlanes);
+
+	for (uint32_t i = 1; i < header.m_lodCount; ++i)
+	{
+		const LodSections & lod = header.m_lods[i];
+
+		buffers->m_lods.push_back({
+			SectionView<uint32_t>(data, lod.m_indices),
+			SectionView<geometry::FacePlane>(data, lod.m_facePlanes),
+			lod.m_error });
+	}
+
+	buffers->m_box = header.m_box;
+	buffers->m_sphere = header.m_sphere;
+	buffers->m_owner = file;
+
+	return std::unique_ptr<geometry::Object>(new CachedModel(std::move(buffers)));
+}
+
+std::unique_ptr<geometry::Object> MeshCache::Load(const std::string & objFilename)
+{
+	const std::string cacheFilename = objFilename + ".cache";
+
+	if (! IsNewer(objFilename, cacheFilename))
+	{
+		std::unique_ptr<geometry::Object> cached = Read(cacheFilename);
+
+		if (cached)
+			return cached;
+	}
+
+	ObjReader reader;
+
+	if (! reader.Read(objFilename))
+		return nullptr;
+
+	std::unique_ptr<geometry::Object> model = reader.GetModel();
+
+	// failing to write the cache only costs the next load time
+	Write(cacheFilename, *model);
+
+	return model;
+}
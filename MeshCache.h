@@ -0,0 +1,24 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "Geometry.h"
+
+// Binary copy of an object's buffers laid out so that the file can be mapped
+// and used in place.
+//
+// The header is followed by sections for the positions and normals, then an
+// index buffer and face planes for each level of detail (the first being the
+// full mesh). Every section starts on a 64 byte boundary.
+class MeshCache
+{
+public:
+	static bool Write(const std::string & filename, const geometry::Object & object);
+
+	static std::unique_ptr<geometry::Object> Read(const std::string & filename);
+
+	// Loads an OBJ file through its cache (the same name with .cache on the
+	// end), the cache is rebuilt first when it's missing or older than the
+	// OBJ file
+	static std::unique_ptr<geometry::Object> Load(const std::string & objFilename);
+};
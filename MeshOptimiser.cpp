@@ -0,0 +1,209 @@
+#include <algorithm>
+#include "MeshOptimiser.h"
+
+namespace geometry
+{
+
+Real AverageCacheMissRatio(ArrayView<uint32_t> indices, std::size_t vertexCount, unsigned cacheSize)
+{
+	if (indices.size() < 3)
+		return 0.0f;
+
+	// a vertex is in the cache while fewer than cacheSize misses have
+	// happened since it was last loaded
+	const uint32_t NotCached = 0xFFFFFFFF;
+
+	std::vector<uint32_t> loadedAt(vertexCount, NotCached);
+	uint32_t misses = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (loadedAt[index] == NotCached || misses - loadedAt[index] >= cacheSize)
+		{
+			loadedAt[index] = misses;
+			++misses;
+		}
+	}
+
+	return static_cast<Real>(misses) / static_cast<Real>(indices.size() / 3);
+}
+
+void OptimiseVertexCache(std::vector<uint32_t> & indices, std::size_t vertexCount, unsigned cacheSize)
+{
+	// http://gfx.cs.princeton.edu/pubs/Sander_2007_%3ETR/tipsy.pdf
+
+	const std::size_t triangles = indices.size() / 3;
+
+	if (triangles == 0)
+		return;
+
+	// triangles around each vertex
+	std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+
+	for (uint32_t index : indices)
+		++firstTriangle[index + 1];
+
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		firstTriangle[v + 1] += firstTriangle[v];
+
+	std::vector<uint32_t> adjacency(indices.size());
+
+	{
+		std::vector<uint32_t> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+
+		for (std::size_t i = 0; i < indices.size(); ++i)
+			adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	// triangles not yet emitted around each vertex
+	std::vector<uint32_t> live(vertexCount);
+
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		live[v] = firstTriangle[v + 1] - firstTriangle[v];
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangles, false);
+
+	// recently used vertices to fall back on when the fan runs out
+	std::vector<uint32_t> deadEnd;
+	deadEnd.reserve(indices.size());
+
+	std::vector<uint32_t> candidates;
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	uint32_t time = cacheSize + 1;
+	std::size_t cursor = 0;
+	int64_t fan = 0;
+
+	while (fan >= 0)
+	{
+		candidates.clear();
+
+		const uint32_t f = static_cast<uint32_t>(fan);
+
+		for (uint32_t k = firstTriangle[f]; k < firstTriangle[f + 1]; ++k)
+		{
+			const uint32_t t = adjacency[k];
+
+			if (emitted[t])
+				continue;
+
+			for (unsigned i = 0; i < 3; ++i)
+			{
+				const uint32_t v = indices[t * 3 + i];
+
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+
+				--live[v];
+
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+
+			emitted[t] = true;
+		}
+
+		// the next fan is the candidate that is still in the cache and has
+		// the most to gain, preferring the oldest so that it isn't evicted
+		// before its triangles are drawn
+		fan = -1;
+		int64_t best = -1;
+
+		for (uint32_t v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+
+			int64_t priority = 0;
+
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = time - cacheTime[v];
+
+			if (priority > best)
+			{
+				best = priority;
+				fan = v;
+			}
+		}
+
+		if (fan >= 0)
+			continue;
+
+		while (! deadEnd.empty())
+		{
+			const uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+
+			if (live[v] > 0)
+			{
+				fan = v;
+				break;
+			}
+		}
+
+		if (fan >= 0)
+			continue;
+
+		for (; cursor < vertexCount; ++cursor)
+		{
+			if (live[cursor] > 0)
+			{
+				fan = static_cast<int64_t>(cursor);
+				break;
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+void OptimiseVertexFetch(std::vector<Vector3> & positions, std::vector<Vector3> & normals,
+	std::vector<uint32_t> & indices)
+{
+	const uint32_t Unused = 0xFFFFFFFF;
+
+	std::vector<uint32_t> remap(positions.size(), Unused);
+
+	std::vector<Vector3> newPositions;
+	std::vector<Vector3> newNormals;
+
+	newPositions.reserve(positions.size());
+	newNormals.reserve(normals.size());
+
+	for (uint32_t & index : indices)
+	{
+		if (remap[index] == Unused)
+		{
+			remap[index] = static_cast<uint32_t>(newPositions.size());
+
+			newPositions.push_back(positions[index]);
+			newNormals.push_back(normals[index]);
+		}
+
+		index = remap[index];
+	}
+
+	positions.swap(newPositions);
+	normals.swap(newNormals);
+}
+
+MeshOptimisation OptimiseMesh(std::vector<Vector3> & positions, std::vector<Vector3> & normals,
+	std::vector<uint32_t> & indices)
+{
+	MeshOptimisation result;
+
+	result.m_acmrBefore = AverageCacheMissRatio(indices, positions.size());
+
+	OptimiseVertexCache(indices, positions.size());
+	OptimiseVertexFetch(positions, normals, indices);
+
+	result.m_acmrAfter = AverageCacheMissRatio(indices, positions.size());
+
+	return result;
+}
+
+}
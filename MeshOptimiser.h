@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ArrayView.h"
+#include "Types.h"
+#include "Vector.h"
+
+namespace geometry
+{
+
+// Average number of vertices that miss a FIFO post-transform cache of the
+// given size per triangle. 0.5 is the best possible on a large regular mesh,
+// 3 is no reuse at all.
+Real AverageCacheMissRatio(ArrayView<uint32_t> indices, std::size_t vertexCount, unsigned cacheSize = 16);
+
+// Reorders the triangles so that vertices are reused while they are still in
+// a cache of the given size (Tipsify, Sander et al. 2007). Linear in the size
+// of the mesh.
+void OptimiseVertexCache(std::vector<uint32_t> & indices, std::size_t vertexCount, unsigned cacheSize = 16);
+
+// Renumbers the vertices in the order the triangles first use them so that
+// vertex data is read front to back, unused vertices are dropped
+void OptimiseVertexFetch(std::vector<Vector3> & positions, std::vector<Vector3> & normals,
+	std::vector<uint32_t> & indices);
+
+struct MeshOptimisation
+{
+	Real m_acmrBefore;
+	Real m_acmrAfter;
+};
+
+// Both of the above, in order
+MeshOptimisation OptimiseMesh(std::vector<Vector3> & positions, std::vector<Vector3> & normals,
+	std::vector<uint32_t> & indices);
+
+}
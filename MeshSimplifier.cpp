@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include "MeshSimplifier.h"
+
+namespace
+{
+	// Sum of squared distances to a set of planes, weighted by the area
+	// each plane came from. Doubles because the terms cancel badly in float.
+	struct Quadric
+	{
+		double a2, ab, ac, ad;
+		double b2, bc, bd;
+		double c2, cd;
+		double d2;
+		double weight;
+
+		void AddPlane(const Vector3 & normal, double d, double w)
+		{
+			const double a = normal.x;
+			const double b = normal.y;
+			const double c = normal.z;
+
+			a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+			b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+			c2 += w * c * c; cd += w * c * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric & rhs)
+		{
+			a2 += rhs.a2; ab += rhs.ab; ac += rhs.ac; ad += rhs.ad;
+			b2 += rhs.b2; bc += rhs.bc; bd += rhs.bd;
+			c2 += rhs.c2; cd += rhs.cd;
+			d2 += rhs.d2;
+			weight += rhs.weight;
+		}
+
+		// mean squared distance from p to the planes
+		double Error(const Vector3 & p) const
+		{
+			const double x = p.x;
+			const double y = p.y;
+			const double z = p.z;
+
+			const double sum =
+				a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+				b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+				c2 * z * z + 2 * cd * z +
+				d2;
+
+			return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+		}
+	};
+
+	// A face of the mesh being simplified, what the error is measured from
+	struct Plane
+	{
+		Vector3 normal;
+		double d;
+
+		double Distance(const Vector3 & p) const
+		{
+			return std::fabs(normal.x * static_cast<double>(p.x) + normal.y * static_cast<double>(p.y) +
+				normal.z * static_cast<double>(p.z) + d);
+		}
+	};
+
+	// Edges on the boundary of an open mesh get an extra plane at right
+	// angles to the face so that the outline doesn't shrink
+	const double BoundaryWeight = 10.0;
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double error;
+
+		bool operator<(const Collapse & rhs) const
+		{
+			return error < rhs.error;
+		}
+	};
+
+	uint64_t EdgeKey(uint32_t a, uint32_t b)
+	{
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	struct PositionHash
+	{
+		std::size_t operator()(const Vector3 & v) const
+		{
+			// -0.0 compares equal to 0.0 so has to hash the same
+			const Real values[3] = {
+				v.x == 0.0f ? 0.0f : v.x,
+				v.y == 0.0f ? 0.0f : v.y,
+				v.z == 0.0f ? 0.0f : v.z,
+			};
+
+			uint32_t bits[3];
+			std::memcpy(bits, values, sizeof(bits));
+
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+}
+
+namespace geometry
+{
+
+std::vector<uint32_t> SimplifyMesh(ArrayView<Vector3> positions, ArrayView<Vector3> normals,
+	ArrayView<uint32_t> indices, std::size_t targetTriangles, Real & error)
+{
+	error = 0.0f;
+
+	const std::size_t vertexCount = positions.size();
+
+	// vertices that only differ in their normal are the same point on the
+	// surface, collapsing works on one representative of each so that seams
+	// don't tear open
+	std::vector<uint32_t> representative(vertexCount);
+
+	{
+		std::unordered_map<Vector3, uint32_t, PositionHash> first;
+		first.reserve(vertexCount);
+
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			representative[v] = first.emplace(positions[v], v).first->second;
+	}
+
+	std::vector<uint32_t> triangles;
+	triangles.reserve(indices.size());
+
+	for (uint32_t index : indices)
+		triangles.push_back(representative[index]);
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+
+	// The planes of the faces each vertex has taken the place of, starting
+	// with its own. The error is measured against these rather than taken
+	// from the quadrics, which only give a mean.
+	std::vector<Plane> planes;
+	std::vector<std::vector<uint32_t>> absorbed(vertexCount);
+
+	planes.reserve(triangles.size() / 3);
+
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(triangles.size());
+
+		for (std::size_t t = 0; t < triangles.size(); t += 3)
+		{
+			for (unsigned i = 0; i < 3; ++i)
+				++edgeUse[EdgeKey(triangles[t + i], triangles[t + (i + 1) % 3])];
+		}
+
+		for (std::size_t t = 0; t < triangles.size(); t += 3)
+		{
+			const Vector3 & p0 = positions[triangles[t]];
+			const Vector3 & p1 = positions[triangles[t + 1]];
+			const Vector3 & p2 = positions[triangles[t + 2]];
+
+			const Vector3 cross = (p1 - p0).Cross(p2 - p0);
+			const Real length = cross.Length();
+
+			if (length <= 0.0f)
+				continue;
+
+			const Vector3 normal = cross / length;
+			const double area = 0.5 * length;
+
+			Quadric face = Quadric();
+			face.AddPlane(normal, -normal.Dot(p0), area);
+
+			const uint32_t plane = static_cast<uint32_t>(planes.size());
+			planes.push_back({ normal, -normal.Dot(p0) });
+
+			for (unsigned i = 0; i < 3; ++i)
+				absorbed[triangles[t + i]].push_back(plane);
+
+			for (unsigned i = 0; i < 3; ++i)
+			{
+				const uint32_t a = triangles[t + i];
+				const uint32_t b = triangles[t + (i + 1) % 3];
+
+				quadrics[a].Add(face);
+
+				if (edgeUse[EdgeKey(a, b)] != 1)
+					continue;
+
+				const Vector3 edge = positions[b] - positions[a];
+				const Vector3 side = edge.Cross(normal);
+				const Real sideLength = side.Length();
+
+				if (sideLength <= 0.0f)
+					continue;
+
+				const Vector3 sideNormal = side / sideLength;
+
+				Quadric boundary = Quadric();
+				boundary.AddPlane(sideNormal, -sideNormal.Dot(positions[a]), BoundaryWeight * edge.Dot(edge));
+
+				quadrics[a].Add(boundary);
+				quadrics[b].Add(boundary);
+			}
+		}
+	}
+
+	std::vector<uint32_t> firstTriangle(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<bool> locked(vertexCount);
+	std::vector<uint32_t> remap(vertexCount);
+
+	double maxDistance = 0.0;
+
+	// passes near the end only find a handful of collapses, landing within
+	// a few percent of the target saves several full passes for nothing
+	const std::size_t closeEnough = targetTriangles + targetTriangles / 32;
+
+	while (triangles.size() / 3 > closeEnough)
+	{
+		const std::size_t triangleCount = triangles.size() / 3;
+
+		// triangles around each vertex
+		std::fill(firstTriangle.begin(), firstTriangle.end(), 0);
+
+		for (uint32_t v : triangles)
+			++firstTriangle[v + 1];
+
+		for (std::size_t v = 0; v < vertexCount; ++v)
+			firstTriangle[v + 1] += firstTriangle[v];
+
+		adjacency.resize(triangles.size());
+
+		{
+			std::vector<uint32_t> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+
+			for (std::size_t i = 0; i < triangles.size(); ++i)
+				adjacency[cursor[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		// the cheaper direction of every edge, an edge shared by two
+		// triangles is in here twice which only costs a skipped entry later
+		collapses.clear();
+
+		for (std::size_t t = 0; t < triangles.size(); t += 3)
+		{
+			for (unsigned i = 0; i < 3; ++i)
+			{
+				const uint32_t a = triangles[t + i];
+				const uint32_t b = triangles[t + (i + 1) % 3];
+
+				Quadric merged = quadrics[a];
+				merged.Add(quadrics[b]);
+
+				const double toB = merged.Error(positions[b]);
+				const double toA = merged.Error(positions[a]);
+
+				if (toB <= toA)
+					collapses.push_back({ a, b, toB });
+				else
+					collapses.push_back({ b, a, toA });
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end());
+
+		std::fill(locked.begin(), locked.end(), false);
+
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			remap[v] = v;
+
+		// each collapse removes about two triangles, stop the pass once
+		// that would reach the target
+		const std::size_t wanted = (triangleCount - targetTriangles + 1) / 2;
+		std::size_t collapsed = 0;
+
+		for (const Collapse & collapse : collapses)
+		{
+			if (collapsed >= wanted)
+				break;
+
+			if (locked[collapse.from] || locked[collapse.to])
+				continue;
+
+			// moving 'from' mustn't flip any of the triangles that survive
+			bool flips = false;
+
+			for (uint32_t k = firstTriangle[collapse.from]; k < firstTriangle[collapse.from + 1] && ! flips; ++k)
+			{
+				const uint32_t t = adjacency[k] * 3;
+
+				const uint32_t a = triangles[t];
+				const uint32_t b = triangles[t + 1];
+				const uint32_t c = triangles[t + 2];
+
+				if (a == collapse.to || b == collapse.to || c == collapse.to)
+					continue;
+
+				const Vector3 & pa = positions[a == collapse.from ? collapse.to : a];
+				const Vector3 & pb = positions[b == collapse.from ? collapse.to : b];
+				const Vector3 & pc = positions[c == collapse.from ? collapse.to : c];
+
+				const Vector3 before = (positions[b] - positions[a]).Cross(positions[c] - positions[a]);
+				const Vector3 after = (pb - pa).Cross(pc - pa);
+
+				flips = (before.Dot(after) <= 0.0f);
+			}
+
+			if (flips)
+				continue;
+
+			// the neighbourhood is fixed for the rest of the pass so the
+			// flip test above stays valid
+			for (uint32_t k = firstTriangle[collapse.from]; k < firstTriangle[collapse.from + 1]; ++k)
+			{
+				const uint32_t t = adjacency[k] * 3;
+
+				locked[triangles[t]] = true;
+				locked[triangles[t + 1]] = true;
+				locked[triangles[t + 2]] = true;
+			}
+
+			locked[collapse.to] = true;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+
+			// 'to' doesn't move so only the faces 'from' stood for can be
+			// any further away than before
+			const Vector3 & target = positions[collapse.to];
+
+			std::vector<uint32_t> & into = absorbed[collapse.to];
+			std::vector<uint32_t> & from = absorbed[collapse.from];
+
+			for (uint32_t plane : from)
+				maxDistance = std::max(maxDistance, planes[plane].Distance(target));
+
+			into.insert(into.end(), from.begin(), from.end());
+			std::vector<uint32_t>().swap(from);
+
+			++collapsed;
+		}
+
+		if (collapsed == 0)
+			break;
+
+		std::size_t write = 0;
+
+		for (std::size_t t = 0; t < triangles.size(); t += 3)
+		{
+			const uint32_t a = remap[triangles[t]];
+			const uint32_t b = remap[triangles[t + 1]];
+			const uint32_t c = remap[triangles[t + 2]];
+
+			if (a == b || b == c || c == a)
+				continue;
+
+			triangles[write++] = a;
+			triangles[write++] = b;
+			triangles[write++] = c;
+		}
+
+		triangles.resize(write);
+	}
+
+	error = static_cast<Real>(maxDistance);
+
+	// the vertices that share each representative's position, so corners can
+	// go back to a vertex with the right normal
+	std::vector<uint32_t> firstWedge(vertexCount + 1);
+	std::vector<uint32_t> wedges(vertexCount);
+
+	for (uint32_t v = 0; v < vertexCount; ++v)
+		++firstWedge[representative[v] + 1];
+
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		firstWedge[v + 1] += firstWedge[v];
+
+	{
+		std::vector<uint32_t> cursor(firstWedge.begin(), firstWedge.end() - 1);
+
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			wedges[cursor[representative[v]]++] = v;
+	}
+
+	for (std::size_t t = 0; t < triangles.size(); t += 3)
+	{
+		const Vector3 & p0 = positions[triangles[t]];
+		const Vector3 & p1 = positions[triangles[t + 1]];
+		const Vector3 & p2 = positions[triangles[t + 2]];
+
+		// only the direction matters
+		const Vector3 face = (p1 - p0).Cross(p2 - p0);
+
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			const uint32_t v = triangles[t + i];
+
+			if (firstWedge[v + 1] - firstWedge[v] == 1)
+				continue;
+
+			uint32_t best = v;
+			Real bestDot = normals[v].Dot(face);
+
+			for (uint32_t k = firstWedge[v] + 1; k < firstWedge[v + 1]; ++k)
+			{
+				const Real dot = normals[wedges[k]].Dot(face);
+
+				if (dot > bestDot)
+				{
+					best = wedges[k];
+					bestDot = dot;
+				}
+			}
+
+			triangles[t + i] = best;
+		}
+	}
+
+	return triangles;
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ArrayView.h"
+#include "Types.h"
+#include "Vector.h"
+
+namespace geometry
+{
+
+// Collapses edges onto existing vertices, cheapest first by quadric error
+// (Garland & Heckbert 1997), until the mesh is down to targetTriangles or no
+// collapse is left that wouldn't fold the surface over. The vertices aren't
+// changed so the result indexes the same buffers. error gets the largest
+// distance from a vertex that was kept to the plane of any face that was
+// collapsed into it, a bound on how far the surface moved rather than the
+// quadrics' mean.
+//
+// Vertices at the same position with different normals (seams and creases)
+// collapse as one, each corner of the result uses the one whose normal is
+// nearest its face's so hard edges stay hard.
+std::vector<uint32_t> SimplifyMesh(ArrayView<Vector3> positions, ArrayView<Vector3> normals,
+	ArrayView<uint32_t> indices, std::size_t targetTriangles, Real & error);
+
+}
@@ -1,182 +1,719 @@
-#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <unordered_map>
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "MeshOptimiser.h"
 #include "ObjReader.h"
+#include "SimdMath.h"
+
+ObjModel::ObjModel(std::vector<Vector3> && positions, std::vector<Vector3> && normals,
+	std::vector<uint32_t> && indices)
+{
+	m_positions = std::move(positions);
+	m_normals = std::move(normals);
+	m_indices = std::move(indices);
+
+	BuffersChanged();
+}
 
 namespace
 {
-	std::vector<std::string> Split(const std::string & string, char c)
+	// Below this a file is parsed on the calling thread, starting threads
+	// would cost more than they save
+	const std::size_t MinChunkSize = 1 << 20;
+
+	// Same idea for the per-face and per-point loops
+	const std::size_t MinParallelItems = 1 << 16;
+
+	const int32_t NoIndex = std::numeric_limits<int32_t>::min();
+
+	enum : uint8_t
 	{
-		std::vector<std::string> out;
+		RelativePoint = 1,
+		RelativeNormal = 2,
+	};
 
-		std::string::size_type cursor = 0;
-		std::string::size_type pos = string.find(c);
+	struct Corner
+	{
+		int32_t point;
+		int32_t normal;
 
-		while (pos != std::string::npos)
-		{
-			out.push_back(string.substr(cursor, pos - cursor));
+		// negative indices count back from the last vertex read, a chunk
+		// doesn't know how many came before it so these are fixed up after
+		uint8_t relative;
+	};
 
-			cursor = pos + 1;
+	struct Chunk
+	{
+		std::vector<Vector3> points;
+		std::vector<Vector3> normals;
 
-			pos = string.find(c, cursor);
-		}
+		// three per triangle, polygons are already split into fans
+		std::vector<Corner> corners;
 
-		if (cursor < string.length())
-			out.push_back(string.substr(cursor));
+		bool ok = true;
+	};
 
-		return out;
+	bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t';
 	}
-}
 
-ObjModel::ObjModel(std::vector<geometry::Triangle> && faces)
-{
-	m_triangles = std::move(faces);
-}
+	bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
 
-namespace
-{
-	struct Face
+	void SkipSpace(const char *& p, const char * end)
 	{
-		static const std::size_t None = -1;
+		while (p < end && IsSpace(*p))
+			++p;
+	}
+
+	double Pow10(int exponent)
+	{
+		// these are all exact in a double so scaling only rounds once, the
+		// mantissa can already have been rounded going into a double (past
+		// 2^53) and the result is rounded again to a float, so the last bit
+		// can be off but that's far below what a model needs
+		static const double table[] =
+		{
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+		};
 
-		std::size_t point = None;
-		std::size_t texture = None;
-		std::size_t normal = None;
+		if (exponent < static_cast<int>(sizeof(table) / sizeof(table[0])))
+			return table[exponent];
 
-		Face(const std::string & face)
+		return std::pow(10.0, exponent);
+	}
+
+	bool ParseReal(const char *& p, const char * end, Real & value)
+	{
+		bool negative = false;
+
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = (*p++ == '-');
+
+		// 19 digits always fit in 64 bits, anything past that is beyond
+		// the precision of a float anyway
+		const uint64_t limit = 1000000000000000000ull;
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		bool digits = false;
+
+		for (; p < end && IsDigit(*p); ++p)
 		{
-			std::vector<std::string> parts = Split(face, '/');
+			digits = true;
 
-			point = std::stoull(parts[0]) - 1;
+			if (mantissa < limit)
+				mantissa = mantissa * 10 + (*p - '0');
+			else
+				++exponent;
+		}
 
-			if (parts.size() > 1)
+		if (p < end && *p == '.')
+		{
+			for (++p; p < end && IsDigit(*p); ++p)
 			{
-				if (! parts[1].empty())
-				{
-					texture = std::stoull(parts[1]) - 1;
-				}
+				digits = true;
 
-				if (parts.size() > 2)
+				if (mantissa < limit)
 				{
-					normal = std::stoull(parts[2]) - 1;
+					mantissa = mantissa * 10 + (*p - '0');
+					--exponent;
 				}
 			}
 		}
-	};
-}
 
-bool ObjReader::Read(const std::string & filename)
-{
-	std::ifstream file(filename);
+		if (! digits)
+			return false;
 
-	if (! file.good())
-		return false;
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
 
-	std::vector<Vector3> points;
-	std::vector<Vector3> normals;
-	std::vector<std::tuple<Face, Face, Face>> faces;
+			bool negativeExponent = false;
+
+			if (p < end && (*p == '-' || *p == '+'))
+				negativeExponent = (*p++ == '-');
+
+			if (p == end || ! IsDigit(*p))
+				return false;
+
+			int e = 0;
+
+			for (; p < end && IsDigit(*p); ++p)
+				e = std::min(e * 10 + (*p - '0'), 9999);
 
-	while (file)
+			exponent += negativeExponent ? -e : e;
+		}
+
+		double result = static_cast<double>(mantissa);
+
+		// a huge power of ten is infinite and zero times that isn't a number
+		if (mantissa == 0)
+			exponent = 0;
+
+		if (exponent < 0)
+			result /= Pow10(-exponent);
+		else if (exponent > 0)
+			result *= Pow10(exponent);
+
+		value = static_cast<Real>(negative ? -result : result);
+
+		return true;
+	}
+
+	bool ParseIndex(const char *& p, const char * end, int32_t & value)
 	{
-		std::string line;
-		std::getline(file, line);
+		bool negative = false;
 
-		if (line[0] == '#')
-			continue;
+		if (p < end && *p == '-')
+		{
+			negative = true;
+			++p;
+		}
 
-		if (line.empty())
-			continue;
+		if (p == end || ! IsDigit(*p))
+			return false;
 
-		std::vector<std::string> parts = Split(line, ' ');
+		int64_t index = 0;
 
-		if (parts[0] == "v")
+		for (; p < end && IsDigit(*p); ++p)
 		{
-			if (parts.size() != 4)
-				return false;
+			index = index * 10 + (*p - '0');
 
-			points.emplace_back(std::stof(parts[1]), std::stof(parts[2]), std::stof(parts[3]));
+			if (index > std::numeric_limits<int32_t>::max())
+				return false;
 		}
-		else if (parts[0] == "vn")
+
+		// OBJ indices start at 1, 0 isn't valid either way
+		if (index == 0)
+			return false;
+
+		value = static_cast<int32_t>(negative ? -index : index);
+
+		return true;
+	}
+
+	// Reads one of v, v/t, v//n or v/t/n and turns the indices 0 based
+	bool ParseCorner(const char *& p, const char * end, const Chunk & chunk, Corner & corner)
+	{
+		int32_t point;
+
+		if (! ParseIndex(p, end, point))
+			return false;
+
+		int32_t normal = NoIndex;
+
+		if (p < end && *p == '/')
 		{
-			if (parts.size() != 4)
+			++p;
+
+			int32_t texture;
+
+			if (p < end && *p != '/' && ! ParseIndex(p, end, texture))
 				return false;
 
-			Vector3 normal(std::stof(parts[1]), std::stof(parts[2]), std::stof(parts[3]));
-			normal.Normalize();
+			if (p < end && *p == '/')
+			{
+				++p;
+
+				if (! ParseIndex(p, end, normal))
+					return false;
+			}
+		}
+
+		if (p < end && ! IsSpace(*p))
+			return false;
+
+		corner.relative = 0;
 
-			normals.emplace_back(normal);
+		if (point < 0)
+		{
+			corner.point = static_cast<int32_t>(chunk.points.size()) + point;
+			corner.relative |= RelativePoint;
 		}
-		else if (parts[0] == "f")
+		else
+		{
+			corner.point = point - 1;
+		}
+
+		if (normal == NoIndex)
 		{
-			if (parts.size() != 4)
+			corner.normal = NoIndex;
+		}
+		else if (normal < 0)
+		{
+			corner.normal = static_cast<int32_t>(chunk.normals.size()) + normal;
+			corner.relative |= RelativeNormal;
+		}
+		else
+		{
+			corner.normal = normal - 1;
+		}
+
+		return true;
+	}
+
+	bool ParseVector(const char *& p, const char * end, Vector3 & v)
+	{
+		SkipSpace(p, end);
+
+		if (! ParseReal(p, end, v.x))
+			return false;
+
+		SkipSpace(p, end);
+
+		if (! ParseReal(p, end, v.y))
+			return false;
+
+		SkipSpace(p, end);
+
+		return ParseReal(p, end, v.z);
+	}
+
+	bool Is(const char * token, std::size_t length, const char * keyword)
+	{
+		return std::strlen(keyword) == length && std::memcmp(token, keyword, length) == 0;
+	}
+
+	bool ParseLine(const char * p, const char * end, Chunk & chunk)
+	{
+		SkipSpace(p, end);
+
+		if (p == end || *p == '#')
+			return true;
+
+		const char * token = p;
+
+		while (p < end && ! IsSpace(*p))
+			++p;
+
+		const std::size_t length = p - token;
+
+		if (Is(token, length, "v"))
+		{
+			Vector3 point;
+
+			// anything after xyz (w or the colours some scanners write) is
+			// ignored
+			if (! ParseVector(p, end, point))
+				return false;
+
+			chunk.points.push_back(point);
+		}
+		else if (Is(token, length, "vn"))
+		{
+			Vector3 normal;
+
+			if (! ParseVector(p, end, normal))
 				return false;
 
-			faces.emplace_back(parts[1], parts[2], parts[3]);
+			chunk.normals.push_back(normal.NormalizedCopy());
+		}
+		else if (Is(token, length, "f"))
+		{
+			Corner first = {};
+			Corner previous = {};
+			unsigned count = 0;
+
+			SkipSpace(p, end);
+
+			while (p < end)
+			{
+				Corner corner;
+
+				if (! ParseCorner(p, end, chunk, corner))
+					return false;
+
+				// quads and n-gons are split into a fan around the first
+				// corner, fine for the convex polygons that OBJ expects
+				if (count == 0)
+				{
+					first = corner;
+				}
+				else if (count >= 2)
+				{
+					chunk.corners.push_back(first);
+					chunk.corners.push_back(previous);
+					chunk.corners.push_back(corner);
+				}
+
+				previous = corner;
+				++count;
+
+				SkipSpace(p, end);
+			}
+
+			if (count < 3)
+				return false;
 		}
 		// Ignore
-		else if (parts[0] == "mtllib" || parts[0] == "usemtl" || parts[0] == "vt" ||
-			parts[0] == "g" || parts[0] == "s" || parts[0] == "o")
+		else if (Is(token, length, "mtllib") || Is(token, length, "usemtl") || Is(token, length, "vt") ||
+			Is(token, length, "g") || Is(token, length, "s") || Is(token, length, "o"))
 		{
-			continue;
+			return true;
 		}
 		else
 		{
 			return false;
 		}
+
+		return true;
 	}
 
-	if (normals.empty())
+	// Calls function(begin, end) over disjoint ranges that cover [0, count)
+	template <typename Function>
+	void ParallelFor(std::size_t count, const Function & function)
 	{
-		const std::size_t size = points.size();
+		JobSystem::Get().ParallelFor(count, MinParallelItems, function);
+	}
 
-		for (std::size_t i = 0; i < size; ++i)
+	// Builds vertices with smooth normals for an indexed mesh. On entry
+	// corners holds three point indices per triangle, on exit it indexes the
+	// returned positions and normals.
+	void GenerateNormals(const std::vector<Vector3> & points, std::vector<uint32_t> & corners,
+		Real creaseAngle, std::vector<Vector3> & positions, std::vector<Vector3> & normals)
+	{
+		const std::size_t triangles = corners.size() / 3;
+
+		// the cross product's length is twice the area so summing these
+		// weights each face by its area
+		std::vector<Vector3> faceNormals(triangles);
+
+		ParallelFor(triangles, [&](std::size_t begin, std::size_t end)
 		{
-			Vector3 normal;
+			for (std::size_t t = begin; t < end; ++t)
+			{
+				faceNormals[t] = geometry::Triangle(
+					points[corners[t * 3]],
+					points[corners[t * 3 + 1]],
+					points[corners[t * 3 + 2]]).Normal();
+			}
+		});
+
+		// the corners around each point, grouped by point so that every
+		// point's neighbourhood can be walked without searching
+		std::vector<uint32_t> firstCorner(points.size() + 1, 0);
+
+		for (uint32_t point : corners)
+			++firstCorner[point + 1];
 
-			const std::size_t index = normals.size();
+		for (std::size_t i = 0; i < points.size(); ++i)
+			firstCorner[i + 1] += firstCorner[i];
 
-			for (auto && face : faces)
+		std::vector<uint32_t> pointCorners(corners.size());
+
+		{
+			std::vector<uint32_t> cursor(firstCorner.begin(), firstCorner.end() - 1);
+
+			for (std::size_t c = 0; c < corners.size(); ++c)
+				pointCorners[cursor[corners[c]]++] = static_cast<uint32_t>(c);
+		}
+
+		auto Normalized = [](const Vector3 & v)
+		{
+			return v.Length() > 0.0f ? v.NormalizedCopy() : v;
+		};
+
+		if (creaseAngle >= 180.0f)
+		{
+			// every face around a point is averaged so each point is a
+			// vertex and the corners can stay as they are
+			normals.resize(points.size());
+
+			ParallelFor(points.size(), [&](std::size_t begin, std::size_t end)
 			{
-				Face & f1 = std::get<0>(face);
-				Face & f2 = std::get<1>(face);
-				Face & f3 = std::get<2>(face);
+				for (std::size_t p = begin; p < end; ++p)
+				{
+					Vector3 sum;
+
+					for (uint32_t k = firstCorner[p]; k < firstCorner[p + 1]; ++k)
+						sum += faceNormals[pointCorners[k] / 3];
+
+					normals[p] = sum;
+				}
+
+				simd::NormaliseVectors(&normals[begin], end - begin);
+			});
+
+			positions = points;
+			return;
+		}
+
+		const Real creaseCosine = std::cos(creaseAngle * DEG_TO_RAD);
 
-				if (f1.point == i || f2.point == i ||f3.point == i)
+		std::vector<Vector3> unitNormals(triangles);
+
+		ParallelFor(triangles, [&](std::size_t begin, std::size_t end)
+		{
+			std::copy(faceNormals.begin() + begin, faceNormals.begin() + end, unitNormals.begin() + begin);
+
+			simd::NormaliseVectors(&unitNormals[begin], end - begin);
+		});
+
+		// a corner only averages the faces on its point that are within the
+		// crease angle of its own face, corners on the same point that end
+		// up with the same normal share a vertex. vertex numbers are local
+		// to the point until the counts are known.
+		std::vector<Vector3> cornerNormals(corners.size());
+		std::vector<uint32_t> cornerVertices(corners.size());
+		std::vector<uint32_t> firstVertex(points.size() + 1, 0);
+
+		ParallelFor(points.size(), [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t p = begin; p < end; ++p)
+			{
+				uint32_t count = 0;
+
+				for (uint32_t k = firstCorner[p]; k < firstCorner[p + 1]; ++k)
 				{
-					geometry::Triangle triangle(points[f1.point], points[f2.point], points[f3.point]);
-					normal += triangle.Normal();
+					const uint32_t corner = pointCorners[k];
+					const uint32_t face = corner / 3;
+
+					Vector3 sum;
 
-					if (f1.point == i)
-						f1.normal = index;
+					for (uint32_t j = firstCorner[p]; j < firstCorner[p + 1]; ++j)
+					{
+						const uint32_t other = pointCorners[j] / 3;
 
-					if (f2.point == i)
-						f2.normal = index;
+						if (other == face || unitNormals[face].Dot(unitNormals[other]) >= creaseCosine)
+							sum += faceNormals[other];
+					}
 
-					if (f3.point == i)
-						f3.normal = index;
+					const Vector3 normal = Normalized(sum);
+
+					uint32_t vertex = count;
+
+					for (uint32_t j = firstCorner[p]; j < k; ++j)
+					{
+						if (cornerNormals[pointCorners[j]] == normal)
+						{
+							vertex = cornerVertices[pointCorners[j]];
+							break;
+						}
+					}
+
+					if (vertex == count)
+						++count;
+
+					cornerNormals[corner] = normal;
+					cornerVertices[corner] = vertex;
 				}
+
+				firstVertex[p + 1] = count;
 			}
+		});
+
+		for (std::size_t i = 0; i < points.size(); ++i)
+			firstVertex[i + 1] += firstVertex[i];
 
-			normals.push_back(normal.NormalizedCopy());
+		positions.resize(firstVertex[points.size()]);
+		normals.resize(firstVertex[points.size()]);
+
+		ParallelFor(points.size(), [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t p = begin; p < end; ++p)
+			{
+				for (uint32_t k = firstCorner[p]; k < firstCorner[p + 1]; ++k)
+				{
+					const uint32_t corner = pointCorners[k];
+					const uint32_t vertex = firstVertex[p] + cornerVertices[corner];
+
+					positions[vertex] = points[p];
+					normals[vertex] = cornerNormals[corner];
+					corners[corner] = vertex;
+				}
+			}
+		});
+	}
+
+	void ParseChunk(const char * begin, const char * end, Chunk & chunk)
+	{
+		const char * p = begin;
+
+		while (p < end)
+		{
+			const char * lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+
+			if (! lineEnd)
+				lineEnd = end;
+
+			const char * contentEnd = lineEnd;
+
+			if (contentEnd > p && contentEnd[-1] == '\r')
+				--contentEnd;
+
+			if (! ParseLine(p, contentEnd, chunk))
+			{
+				chunk.ok = false;
+				return;
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+}
+
+bool ObjReader::Read(const std::string & filename)
+{
+	MappedFile file(filename);
+
+	if (! file.IsOpen())
+		return false;
+
+	const char * data = file.GetData();
+	const std::size_t size = file.GetSize();
+
+	JobSystem & jobs = JobSystem::Get();
+
+	const std::size_t chunkCount = std::max<std::size_t>(1, std::min<std::size_t>(jobs.GetNumThreads(), size / MinChunkSize));
+
+	// chunks are split at line boundaries so every line is parsed whole by
+	// exactly one thread
+	std::vector<const char *> bounds(chunkCount + 1);
+
+	bounds[0] = data;
+	bounds[chunkCount] = data + size;
+
+	for (std::size_t i = 1; i < chunkCount; ++i)
+	{
+		const char * split = std::max(data + (size / chunkCount) * i, bounds[i - 1]);
+		const char * newline = static_cast<const char *>(std::memchr(split, '\n', (data + size) - split));
+
+		bounds[i] = newline ? newline + 1 : data + size;
+	}
+
+	std::vector<Chunk> chunks(chunkCount);
+	JobCounter parsed;
+
+	for (std::size_t i = 1; i < chunkCount; ++i)
+		jobs.Run([&bounds, &chunks, i]() { ParseChunk(bounds[i], bounds[i + 1], chunks[i]); }, &parsed);
+
+	ParseChunk(bounds[0], bounds[1], chunks[0]);
+
+	jobs.Wait(parsed);
+
+	std::size_t pointCount = 0;
+	std::size_t normalCount = 0;
+	std::size_t cornerCount = 0;
+
+	for (auto && chunk : chunks)
+	{
+		if (! chunk.ok)
+			return false;
+
+		pointCount += chunk.points.size();
+		normalCount += chunk.normals.size();
+		cornerCount += chunk.corners.size();
+	}
+
+	std::vector<Vector3> points;
+	std::vector<Vector3> normals;
+
+	points.reserve(pointCount);
+	normals.reserve(normalCount);
+
+	// corner point and normal indices into the merged arrays
+	std::vector<uint32_t> cornerPoints;
+	std::vector<uint32_t> cornerNormals;
+
+	cornerPoints.reserve(cornerCount);
+	cornerNormals.reserve(cornerCount);
+
+	const bool hasNormals = (normalCount != 0);
+
+	for (auto && chunk : chunks)
+	{
+		const int64_t pointOffset = points.size();
+		const int64_t normalOffset = normals.size();
+
+		points.insert(points.end(), chunk.points.begin(), chunk.points.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+		for (auto && corner : chunk.corners)
+		{
+			const int64_t point = corner.point + ((corner.relative & RelativePoint) ? pointOffset : 0);
+
+			if (point < 0 || point >= static_cast<int64_t>(pointCount))
+				return false;
+
+			cornerPoints.push_back(static_cast<uint32_t>(point));
+
+			if (! hasNormals)
+				continue;
+
+			if (corner.normal == NoIndex)
+				return false;
+
+			const int64_t normal = corner.normal + ((corner.relative & RelativeNormal) ? normalOffset : 0);
+
+			if (normal < 0 || normal >= static_cast<int64_t>(normalCount))
+				return false;
+
+			cornerNormals.push_back(static_cast<uint32_t>(normal));
 		}
 	}
 
-	std::vector<geometry::Triangle> triangles;
+	chunks.clear();
 
-	for (auto && face : faces)
+	std::vector<Vector3> vertexPositions;
+	std::vector<Vector3> vertexNormals;
+	std::vector<uint32_t> indices;
+
+	if (! hasNormals)
+	{
+		GenerateNormals(points, cornerPoints, m_creaseAngle, vertexPositions, vertexNormals);
+
+		indices.swap(cornerPoints);
+	}
+	else
 	{
-		Face f1 = std::get<0>(face);
-		Face f2 = std::get<1>(face);
-		Face f3 = std::get<2>(face);
+		// A vertex is a unique pairing of a point and a normal, corners of
+		// different faces that share both share the vertex
+		std::unordered_map<uint64_t, uint32_t> vertices;
+		vertices.reserve(pointCount);
+
+		indices.reserve(cornerCount);
+
+		for (std::size_t i = 0; i < cornerCount; ++i)
+		{
+			const uint64_t key = (static_cast<uint64_t>(cornerPoints[i]) << 32) | cornerNormals[i];
+
+			auto iter = vertices.find(key);
 
-		assert(f1.normal != Face::None);
-		assert(f2.normal != Face::None);
-		assert(f3.normal != Face::None);
+			if (iter == vertices.end())
+			{
+				const uint32_t index = static_cast<uint32_t>(vertexPositions.size());
+
+				vertexPositions.push_back(points[cornerPoints[i]]);
+				vertexNormals.push_back(normals[cornerNormals[i]]);
+
+				iter = vertices.emplace(key, index).first;
+			}
 
-		triangles.emplace_back(points[f1.point], points[f2.point], points[f3.point],
-			normals[f1.normal], normals[f2.normal], normals[f3.normal]);
+			indices.push_back(iter->second);
+		}
 	}
 
-	m_model.reset(new ObjModel(std::move(triangles)));
+	// file order rarely reuses vertices while they're still cached
+	const geometry::MeshOptimisation optimisation =
+		geometry::OptimiseMesh(vertexPositions, vertexNormals, indices);
+
+	const std::string report = filename + ": ACMR " + std::to_string(optimisation.m_acmrBefore) +
+		" -> " + std::to_string(optimisation.m_acmrAfter) + "\n";
+
+	OutputDebugString(report.c_str());
+
+	m_model.reset(new ObjModel(std::move(vertexPositions), std::move(vertexNormals), std::move(indices)));
+	m_model->GenerateLods();
 
 	return true;
 }
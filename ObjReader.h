@@ -7,16 +7,26 @@ class ObjModel
 	: public geometry::Object
 {
 public:
-	ObjModel(std::vector<geometry::Triangle> && faces);
+	ObjModel(std::vector<Vector3> && positions, std::vector<Vector3> && normals,
+		std::vector<uint32_t> && indices);
 };
 
 class ObjReader
 {
 public:
+	// Only used when the file has no normals. Faces meeting at a sharper
+	// angle than this get separate vertices so the edge stays hard, the
+	// default of 180 smooths everything.
+	void SetCreaseAngle(Units::Degrees_t, Real angle)
+	{
+		m_creaseAngle = angle;
+	}
+
 	bool Read(const std::string & filename);
 
 	std::unique_ptr<ObjModel> GetModel();
 
 private:
 	std::unique_ptr<ObjModel> m_model;
+	Real m_creaseAngle = 180.0;
 };
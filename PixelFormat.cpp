@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <emmintrin.h>
+#include <stdexcept>
+#include "PixelFormat.h"
+
+namespace
+{
+	// Clamped to 0-1, scaled and rounded to the nearest
+	__m128i ToUnorm(__m128 values, __m128 scale)
+	{
+		const __m128 clamped = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+
+		return _mm_cvtps_epi32(_mm_mul_ps(clamped, scale));
+	}
+
+	// Four pixels of four 0-255 lanes each as sixteen bytes, the values are
+	// in range so the saturating packs never saturate
+	__m128i PackBytes(__m128i a, __m128i b, __m128i c, __m128i d)
+	{
+		return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+	}
+
+	// Unpacked r, g, b, a floats to display pixels
+	void FloatsToDisplay(const float * rgba, uint32_t * display, unsigned count)
+	{
+		const __m128 scale = _mm_set1_ps(255.0f);
+
+		__m128i lanes[4];
+		unsigned filled = 0;
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			const __m128 value = _mm_loadu_ps(rgba + i * 4);
+
+			// b g r a
+			lanes[filled++] = ToUnorm(_mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 0, 1, 2)), scale);
+
+			if (filled == 4)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(display + i - 3),
+					PackBytes(lanes[0], lanes[1], lanes[2], lanes[3]));
+
+				filled = 0;
+			}
+		}
+
+		for (unsigned i = 0; i < filled; ++i)
+		{
+			const __m128i packed = PackBytes(lanes[i], lanes[i], lanes[i], lanes[i]);
+
+			display[count - filled + i] = static_cast<uint32_t>(_mm_cvtsi128_si32(packed));
+		}
+	}
+
+	uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+		const uint32_t biased = (bits >> 23) & 0xff;
+		const int exponent = static_cast<int>(biased) - 127 + 15;
+
+		uint32_t mantissa = bits & 0x7fffff;
+
+		// infinity stays infinity, a NaN stays some NaN
+		if (biased == 0xff)
+			return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+		if (exponent >= 31)
+			return sign | 0x7c00;
+
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+				return sign;
+
+			// denormal, the implicit one has to be shifted in too
+			mantissa |= 0x800000;
+
+			const unsigned shift = 14 - exponent;
+
+			uint32_t half = mantissa >> shift;
+
+			if ((mantissa >> (shift - 1)) & 1)
+				++half;
+
+			return sign | static_cast<uint16_t>(half);
+		}
+
+		uint32_t half = (exponent << 10) | (mantissa >> 13);
+
+		// a carry out of the mantissa correctly bumps the exponent
+		if (mantissa & 0x1000)
+			++half;
+
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	float HalfToFloat(uint16_t half)
+	{
+		const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x3ff;
+
+		uint32_t bits;
+
+		if (exponent == 0x1f)
+		{
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else if (exponent == 0)
+		{
+			if (mantissa == 0)
+			{
+				bits = sign;
+			}
+			else
+			{
+				// denormal, normalise it
+				exponent = 127 - 15 + 1;
+
+				while (! (mantissa & 0x400))
+				{
+					mantissa <<= 1;
+					--exponent;
+				}
+
+				bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+			}
+		}
+		else
+		{
+			bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+
+		return value;
+	}
+}
+
+namespace pixels
+{
+
+void RGBA8::Pack(const Colour * colours, Value * values)
+{
+	const __m128 scale = _mm_set1_ps(255.0f);
+
+	__m128i lanes[4];
+
+	for (unsigned i = 0; i < 4; ++i)
+		lanes[i] = ToUnorm(_mm_setr_ps(colours[i].r, colours[i].g, colours[i].b, 1.0f), scale);
+
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(values), PackBytes(lanes[0], lanes[1], lanes[2], lanes[3]));
+}
+
+void RGBA8::ToDisplay(const Value * values, uint32_t * display, unsigned count)
+{
+	unsigned i = 0;
+
+	// green and alpha stay put, red and blue swap over
+	const __m128i keep = _mm_set1_epi32(0xff00ff00);
+	const __m128i low = _mm_set1_epi32(0xff);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+
+		const __m128i swapped = _mm_or_si128(
+			_mm_and_si128(value, keep),
+			_mm_or_si128(
+				_mm_and_si128(_mm_srli_epi32(value, 16), low),
+				_mm_slli_epi32(_mm_and_si128(value, low), 16)));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(display + i), swapped);
+	}
+
+	for (; i < count; ++i)
+	{
+		const uint32_t value = values[i];
+
+		display[i] = (value & 0xff00ff00) | ((value >> 16) & 0xff) | ((value & 0xff) << 16);
+	}
+}
+
+void BGRA8::Pack(const Colour * colours, Value * values)
+{
+	const __m128 scale = _mm_set1_ps(255.0f);
+
+	__m128i lanes[4];
+
+	for (unsigned i = 0; i < 4; ++i)
+		lanes[i] = ToUnorm(_mm_setr_ps(colours[i].b, colours[i].g, colours[i].r, 1.0f), scale);
+
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(values), PackBytes(lanes[0], lanes[1], lanes[2], lanes[3]));
+}
+
+void BGRA8::ToDisplay(const Value * values, uint32_t * display, unsigned count)
+{
+	unsigned i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(display + i), value);
+	}
+
+	std::memcpy(display + i, values + i, (count - i) * sizeof(Value));
+}
+
+void RGB565::Pack(const Colour * colours, Value * values)
+{
+	const __m128 scale = _mm_setr_ps(31.0f, 63.0f, 31.0f, 0.0f);
+
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		int32_t lanes[4];
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes),
+			ToUnorm(_mm_setr_ps(colours[i].r, colours[i].g, colours[i].b, 0.0f), scale));
+
+		values[i] = static_cast<Value>((lanes[0] << 11) | (lanes[1] << 5) | lanes[2]);
+	}
+}
+
+void RGB565::ToDisplay(const Value * values, uint32_t * display, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i)
+	{
+		const uint32_t r = (values[i] >> 11) & 0x1f;
+		const uint32_t g = (values[i] >> 5) & 0x3f;
+		const uint32_t b = values[i] & 0x1f;
+
+		// the top bits are repeated in the bottom so that full scale is 255
+		display[i] = 0xff000000 |
+			(((r << 3) | (r >> 2)) << 16) |
+			(((g << 2) | (g >> 4)) << 8) |
+			((b << 3) | (b >> 2));
+	}
+}
+
+void RGBA16F::Pack(const Colour * colours, Value * values)
+{
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		values[i].r = FloatToHalf(colours[i].r);
+		values[i].g = FloatToHalf(colours[i].g);
+		values[i].b = FloatToHalf(colours[i].b);
+		values[i].a = 0x3c00;
+	}
+}
+
+void RGBA16F::ToDisplay(const Value * values, uint32_t * display, unsigned count)
+{
+	float rgba[16];
+
+	for (unsigned i = 0; i < count; i += 4)
+	{
+		const unsigned n = std::min(count - i, 4u);
+
+		for (unsigned j = 0; j < n; ++j)
+		{
+			rgba[j * 4] = HalfToFloat(values[i + j].r);
+			rgba[j * 4 + 1] = HalfToFloat(values[i + j].g);
+			rgba[j * 4 + 2] = HalfToFloat(values[i + j].b);
+			rgba[j * 4 + 3] = HalfToFloat(values[i + j].a);
+		}
+
+		FloatsToDisplay(rgba, display + i, n);
+	}
+}
+
+void RGBA32F::Pack(const Colour * colours, Value * values)
+{
+	for (unsigned i = 0; i < 4; ++i)
+		values[i] = { colours[i].r, colours[i].g, colours[i].b, 1.0f };
+}
+
+void RGBA32F::ToDisplay(const Value * values, uint32_t * display, unsigned count)
+{
+	FloatsToDisplay(&values[0].r, display, count);
+}
+
+unsigned BytesPerPixel(PixelFormat format)
+{
+	switch (format)
+	{
+	case PixelFormat::RGBA8: return sizeof(RGBA8::Value);
+	case PixelFormat::BGRA8: return sizeof(BGRA8::Value);
+	case PixelFormat::RGB565: return sizeof(RGB565::Value);
+	case PixelFormat::RGBA16F: return sizeof(RGBA16F::Value);
+	case PixelFormat::RGBA32F: return sizeof(RGBA32F::Value);
+	}
+
+	throw std::runtime_error("unknown pixel format");
+}
+
+bool IsFloat(PixelFormat format)
+{
+	return format == PixelFormat::RGBA16F || format == PixelFormat::RGBA32F;
+}
+
+void ToDisplay(PixelFormat format, const void * values, uint32_t * display, unsigned count)
+{
+	switch (format)
+	{
+	case PixelFormat::RGBA8: RGBA8::ToDisplay(static_cast<const RGBA8::Value *>(values), display, count); return;
+	case PixelFormat::BGRA8: BGRA8::ToDisplay(static_cast<const BGRA8::Value *>(values), display, count); return;
+	case PixelFormat::RGB565: RGB565::ToDisplay(static_cast<const RGB565::Value *>(values), display, count); return;
+	case PixelFormat::RGBA16F: RGBA16F::ToDisplay(static_cast<const RGBA16F::Value *>(values), display, count); return;
+	case PixelFormat::RGBA32F: RGBA32F::ToDisplay(static_cast<const RGBA32F::Value *>(values), display, count); return;
+	}
+
+	throw std::runtime_error("unknown pixel format");
+}
+
+void ToRGB(PixelFormat format, const void * values, float * rgb, unsigned count)
+{
+	assert(IsFloat(format));
+
+	if (format == PixelFormat::RGBA16F)
+	{
+		const RGBA16F::Value * halves = static_cast<const RGBA16F::Value *>(values);
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			rgb[i * 3] = HalfToFloat(halves[i].r);
+			rgb[i * 3 + 1] = HalfToFloat(halves[i].g);
+			rgb[i * 3 + 2] = HalfToFloat(halves[i].b);
+		}
+
+		return;
+	}
+
+	const RGBA32F::Value * floats = static_cast<const RGBA32F::Value *>(values);
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		rgb[i * 3] = floats[i].r;
+		rgb[i * 3 + 1] = floats[i].g;
+		rgb[i * 3 + 2] = floats[i].b;
+	}
+}
+
+}
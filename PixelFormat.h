@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include "Colour.h"
+
+enum class PixelFormat
+{
+	RGBA8,
+	BGRA8,
+	RGB565,
+	RGBA16F,
+	RGBA32F,
+};
+
+// How each format stores a pixel. Pack turns four shaded colours into four
+// stored values and ToDisplay turns a run of stored values into the 32 bit
+// BGRX that a GDI bitmap holds. The frame buffer instantiates its loops for
+// each of these so nothing is looked up per pixel.
+//
+// The 8 bit and 565 formats clamp to 0-1, the float formats keep whatever
+// the shader wrote and are only clamped when shown.
+namespace pixels
+{
+
+struct RGBA8
+{
+	typedef uint32_t Value;
+
+	static const PixelFormat kFormat = PixelFormat::RGBA8;
+
+	static void Pack(const Colour * colours, Value * values);
+	static void ToDisplay(const Value * values, uint32_t * display, unsigned count);
+};
+
+struct BGRA8
+{
+	typedef uint32_t Value;
+
+	static const PixelFormat kFormat = PixelFormat::BGRA8;
+
+	static void Pack(const Colour * colours, Value * values);
+	static void ToDisplay(const Value * values, uint32_t * display, unsigned count);
+};
+
+struct RGB565
+{
+	typedef uint16_t Value;
+
+	static const PixelFormat kFormat = PixelFormat::RGB565;
+
+	static void Pack(const Colour * colours, Value * values);
+	static void ToDisplay(const Value * values, uint32_t * display, unsigned count);
+};
+
+struct RGBA16F
+{
+	struct Value
+	{
+		uint16_t r, g, b, a;
+	};
+
+	static const PixelFormat kFormat = PixelFormat::RGBA16F;
+
+	static void Pack(const Colour * colours, Value * values);
+	static void ToDisplay(const Value * values, uint32_t * display, unsigned count);
+};
+
+struct RGBA32F
+{
+	struct Value
+	{
+		float r, g, b, a;
+	};
+
+	static const PixelFormat kFormat = PixelFormat::RGBA32F;
+
+	static void Pack(const Colour * colours, Value * values);
+	static void ToDisplay(const Value * values, uint32_t * display, unsigned count);
+};
+
+// For code that gets runs of pixels in a format it only knows at run time,
+// the format is looked up once a call
+
+unsigned BytesPerPixel(PixelFormat format);
+
+// Whether values over 1 are kept
+bool IsFloat(PixelFormat format);
+
+void ToDisplay(PixelFormat format, const void * values, uint32_t * display, unsigned count);
+
+// Three floats a pixel, only for float formats
+void ToRGB(PixelFormat format, const void * values, float * rgb, unsigned count);
+
+}
@@ -5,15 +5,15 @@ Projection::Projection(Real fov, Real znear, Real zfar, unsigned width, unsigned
 	: m_fov(fov)
 	, m_znear(znear)
 	, m_zfar(zfar)
+	, m_aspect((Real)width / (Real)height)
 	, m_width(width)
 	, m_height(height)
 { }
 
 Matrix4 Projection::GetProjectionMatrix() const
 {
-	Real aspect = (Real)m_width / (Real)m_height;
 	Real scalex = 1 / tan(m_fov * DEG_TO_RAD * 0.5f);
-	Real scaley = scalex * aspect;
+	Real scaley = scalex * m_aspect;
 	Real zClip1 = -((m_zfar + m_znear) / (m_zfar - m_znear));
 	Real zClip2 = -((2 * m_znear * m_zfar) / (m_zfar - m_znear));
 
@@ -34,3 +34,12 @@ Real Projection::ToScreenY(Real y) const
 {
 	return (1.0f - ((y + 1.0f) / 2.0f)) * m_height;
 }
+
+Real Projection::ToScreenSize(Real size, Real distance) const
+{
+	// the fov is horizontal so this matches the x scale of the projection
+	// matrix, a full width of 2 in device coordinates covers m_width pixels
+	Real scalex = 1 / tan(m_fov * DEG_TO_RAD * 0.5f);
+
+	return (size / distance) * scalex * m_width * 0.5f;
+}
@@ -7,17 +7,31 @@
 class Projection
 {
 public:
+	// The aspect ratio is fixed by the width and height given here
 	Projection(Real fov, Real znear, Real zfar, unsigned width, unsigned height);
 
 	Matrix4 GetProjectionMatrix() const;
 
+	// Maps to a screen of another size, e.g. to draw at a lower resolution.
+	// The projection matrix doesn't change.
+	void SetScreenSize(unsigned width, unsigned height)
+	{
+		m_width = width;
+		m_height = height;
+	}
+
 	Real ToScreenX(Real x) const;
 	Real ToScreenY(Real y) const;
 
+	// Size in pixels of something size units across at distance units from
+	// the camera
+	Real ToScreenSize(Real size, Real distance) const;
+
 private:
 	Real m_fov;
 	Real m_znear;
 	Real m_zfar;
+	Real m_aspect;
 	unsigned m_width;
 	unsigned m_height;
 };
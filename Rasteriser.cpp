@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include "ClipPlane.h"
@@ -10,15 +11,42 @@
 Rasteriser::Rasteriser(FrameBuffer *pFrame, RenderMode mode, ShadyObject * shader)
 	: m_pFrame(pFrame)
 	, m_mode(mode)
+	, m_left(0)
+	, m_top(0)
+	, m_right(pFrame->GetWidth())
+	, m_bottom(pFrame->GetHeight())
 	, m_fragmentShader(shader)
 {
 }
 
-void Rasteriser::DrawTriangle(const std::array<VertexShaderOutput, 3> & triangle)
+void Rasteriser::DrawTriangle(const TriangleList & list, std::size_t triangle)
 {
-	if (ShouldCull(triangle))
+	const std::array<VertexShaderOutput, 3> vertices = { {
+		list.m_vertices[list.m_indices[triangle * 3]],
+		list.m_vertices[list.m_indices[triangle * 3 + 1]],
+		list.m_vertices[list.m_indices[triangle * 3 + 2]]
+	} };
+
+	// setting up the fragment shader is the expensive part so triangles
+	// entirely outside the scissor are dropped first
+	const Real top = std::min(std::min(vertices[0].m_screen.y, vertices[1].m_screen.y), vertices[2].m_screen.y);
+	const Real bottom = std::max(std::max(vertices[0].m_screen.y, vertices[1].m_screen.y), vertices[2].m_screen.y);
+
+	// the scissor's bottom and right are one past its last row and column
+	if (bottom < m_top || top >= m_bottom)
 		return;
 
+	const Real left = std::min(std::min(vertices[0].m_screen.x, vertices[1].m_screen.x), vertices[2].m_screen.x);
+	const Real right = std::max(std::max(vertices[0].m_screen.x, vertices[1].m_screen.x), vertices[2].m_screen.x);
+
+	if (right < m_left || left >= m_right)
+		return;
+
+	DrawTriangle(vertices);
+}
+
+void Rasteriser::DrawTriangle(const std::array<VertexShaderOutput, 3> & triangle)
+{
 	if (m_mode == RenderMode::WireFrame)
 	{
 		DrawWireFrameTriangle(triangle);
@@ -38,6 +66,7 @@ void Rasteriser::DrawTriangle(const std::array<VertexShaderOutput, 3> & triangle
 
 	shader.SetTriangleContext(&triangle);
 	shader.SetLightPosition(m_lightPosition);
+	shader.SetTint(m_tint);
 
 	DrawTriangle(shader, points[0].x, points[0].y, points[1].x, points[1].y, points[2].x, points[2].y);
 
@@ -64,6 +93,17 @@ void Rasteriser::DrawTriangle(const FragmentShader & fragmentShader,
 
 	Real delta1 = (x3 - x1) / height;
 
+	y_start = std::max(y_start, static_cast<int>(m_top));
+	y_end = std::min(y_end, static_cast<int>(m_bottom) - 1);
+
+	// shaded pixels are held back and written a batch at a time, none of a
+	// triangle's pixels overlap so the order they land in doesn't matter
+	const unsigned kBatch = 16;
+
+	FrameBuffer::Pixel pixels[kBatch];
+	Colour colours[kBatch];
+	unsigned shaded = 0;
+
 	for (int y = y_start; y <= y_end; ++y)
 	{
 		Real ry = y;
@@ -92,14 +132,27 @@ void Rasteriser::DrawTriangle(const FragmentShader & fragmentShader,
 		Real px2_floor = std::floor(px2);
 		int px_end = (px2 - px2_floor <= 0.5) ? px2_floor - 1.0 : px2_floor;
 
+		px_start = std::max(px_start, static_cast<int>(m_left));
+		px_end = std::min(px_end, static_cast<int>(m_right) - 1);
+
 		for (int x = px_start; x <= px_end; ++x)
 		{
-			Colour colour;
+			const FrameBuffer::Pixel pixel = m_pFrame->Locate(x, y);
+
+			if (! fragmentShader.Execute(x, y, m_pFrame, pixel, colours[shaded]))
+				continue;
 
-			if (fragmentShader.Execute(x, y, m_pFrame, colour))
-				m_pFrame->SetPixel(x, y, colour);
+			pixels[shaded++] = pixel;
+
+			if (shaded == kBatch)
+			{
+				m_pFrame->SetPixels(pixels, colours, shaded);
+				shaded = 0;
+			}
 		}
 	}
+
+	m_pFrame->SetPixels(pixels, colours, shaded);
 }
 
 void Rasteriser::DrawWireFrameTriangle(const std::array<VertexShaderOutput, 3> & triangle)
@@ -107,17 +160,17 @@ void Rasteriser::DrawWireFrameTriangle(const std::array<VertexShaderOutput, 3> &
 	DrawLine(
 		triangle[0].m_screen.x, triangle[0].m_screen.y,
 		triangle[1].m_screen.x, triangle[1].m_screen.y,
-		Colour::White);
+		m_tint);
 
 	DrawLine(
 		triangle[1].m_screen.x, triangle[1].m_screen.y,
 		triangle[2].m_screen.x, triangle[2].m_screen.y,
-		Colour::White);
+		m_tint);
 
 	DrawLine(
 		triangle[2].m_screen.x, triangle[2].m_screen.y,
 		triangle[0].m_screen.x, triangle[0].m_screen.y,
-		Colour::White);
+		m_tint);
 }
 
 void Rasteriser::DrawLine(int x1, int y1, int x2, int y2, const Colour & colour)
@@ -134,8 +187,8 @@ void Rasteriser::DrawLine(int x1, int y1, int x2, int y2, const Colour & colour)
 
 	while (true)
 	{
-		if (x >= 0 && y >= 0 && x < m_pFrame->GetWidth() && y < m_pFrame->GetHeight())
-			m_pFrame->SetPixel(x, y, colour);
+		if (x >= static_cast<int>(m_left) && y >= static_cast<int>(m_top) && x < static_cast<int>(m_right) && y < static_cast<int>(m_bottom))
+			m_pFrame->SetPixel(m_pFrame->Locate(x, y), colour);
 
 		if (x == x2 && y == y2)
 			break;
@@ -156,15 +209,17 @@ void Rasteriser::DrawLine(int x1, int y1, int x2, int y2, const Colour & colour)
 	}
 }
 
-bool Rasteriser::ShouldCull(const std::array<VertexShaderOutput, 3> & triangle)
+void Rasteriser::SetupTriangle(TriangleList & list, uint32_t a, uint32_t b, uint32_t c) const
 {
 	const Real width = m_pFrame->GetWidth();
 	const Real height = m_pFrame->GetHeight();
 
 	bool shouldClip = false;
 
-	for (auto && v : triangle)
+	for (uint32_t index : { a, b, c })
 	{
+		const VertexShaderOutput & v = list.m_vertices[index];
+
 		if (v.m_screen.x < 0 || v.m_screen.x > width)
 			shouldClip = true;
 
@@ -172,53 +227,66 @@ bool Rasteriser::ShouldCull(const std::array<VertexShaderOutput, 3> & triangle)
 			shouldClip = true;
 
 		if (v.m_projected.z < -1.0 || v.m_projected.z > 1.0)
-			return true;
+			return;
 	}
 
 	if (! shouldClip)
-		return false;
+	{
+		list.m_indices.push_back(a);
+		list.m_indices.push_back(b);
+		list.m_indices.push_back(c);
+		return;
+	}
 
-	std::vector<VertexShaderOutput> points(triangle.begin(), triangle.end());
+	// each plane adds at most one point so the polygon never gets past 7,
+	// clipping ping-pongs between two buffers on the stack
+	VertexShaderOutput points[7];
+	VertexShaderOutput clipped[7];
+
+	points[0] = list.m_vertices[a];
+	points[1] = list.m_vertices[b];
+	points[2] = list.m_vertices[c];
 
 	ClipPlane top({ 0.0, 0.0 }, { 1.0, 0.0 });
 	ClipPlane bottom({ 0.0, height-0.1f }, { -1.0, 0.0 });
 	ClipPlane left({ 0.0, 0.0 }, { 0.0, -1.0 });
 	ClipPlane right({ width-0.1f, 0.0 }, { 0.0, 1.0 });
 
-	points = top.Clip(points);
-	points = bottom.Clip(points);
-	points = left.Clip(points);
-	points = right.Clip(points);
+	std::size_t count = 3;
+
+	count = top.Clip(points, count, clipped);
+	count = bottom.Clip(clipped, count, points);
+	count = left.Clip(points, count, clipped);
+	count = right.Clip(clipped, count, points);
 
-	if (points.size() < 3)
+	if (count < 3)
 	{
-		assert(points.empty());
-		return true;
+		assert(count == 0);
+		return;
 	}
 
-	const std::size_t limit = points.size();
-
-	for (std::size_t i = 2; i < limit; ++i)
+	// TODO: how can we avoid this?
+	// they go to tiny non-zero values sometimes
+	for (std::size_t i = 0; i < count; ++i)
 	{
-		std::array<VertexShaderOutput, 3> clipped;
+		VertexShaderOutput & v = points[i];
 
-		clipped[0] = points[0];
-		clipped[1] = points[i-1];
-		clipped[2] = points[i];
+		if (v.m_screen.x < 0)
+			v.m_screen.x = 0;
 
-		// TODO: how can we avoid this?
-		// they go to tiny non-zero values sometimes
-		for (auto && v : clipped)
-		{
-			if (v.m_screen.x < 0)
-				v.m_screen.x = 0;
+		if (v.m_screen.y < 0)
+			v.m_screen.y = 0;
+	}
 
-			if (v.m_screen.y < 0)
-				v.m_screen.y = 0;
-		}
+	// the clipped polygon is convex so it's drawn as a fan
+	const uint32_t first = static_cast<uint32_t>(list.m_vertices.size());
 
-		DrawTriangle(clipped);
-	}
+	list.m_vertices.insert(list.m_vertices.end(), points, points + count);
 
-	return true;
+	for (uint32_t i = 2; i < count; ++i)
+	{
+		list.m_indices.push_back(first);
+		list.m_indices.push_back(first + i - 1);
+		list.m_indices.push_back(first + i);
+	}
 }
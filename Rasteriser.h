@@ -4,6 +4,7 @@
 #include <Windows.h>
 #include "Colour.h"
 #include "FragmentShader.h"
+#include "FrameArena.h"
 #include "Geometry.h"
 #include "VertexShader.h"
 
@@ -21,6 +22,25 @@ enum class RenderMode
 	End,
 };
 
+// Shaded vertices and the triangles left between them once they've been
+// culled and clipped to the screen, three indices a triangle. Only kept for
+// the frame so it lives in the frame arena.
+struct TriangleList
+{
+	ArenaVector<VertexShaderOutput> m_vertices;
+	ArenaVector<uint32_t> m_indices;
+
+	// debug lines in screen space, two points each
+	ArenaVector<Point> m_lines;
+
+	void Clear()
+	{
+		m_vertices.clear();
+		m_indices.clear();
+		m_lines.clear();
+	}
+};
+
 class Rasteriser
 {
 public:
@@ -36,18 +56,52 @@ public:
 		m_fragmentShader = shader;
 	}
 
-	void DrawTriangle(const std::array<VertexShaderOutput, 3> & triangle);
+	// Colour of the instance being drawn, wireframes are drawn in it too
+	void SetTint(const Colour & tint)
+	{
+		m_tint = tint;
+	}
+
+	// Only rows top to bottom - 1 are drawn. Lets several rasterisers work
+	// on the same frame at once in bands that don't overlap.
+	void SetScissor(unsigned top, unsigned bottom)
+	{
+		m_top = top;
+		m_bottom = bottom;
+	}
+
+	// Columns left to right - 1 of those rows, for drawing a bucket of the
+	// frame at a time
+	void SetScissor(unsigned left, unsigned top, unsigned right, unsigned bottom)
+	{
+		m_left = left;
+		m_right = right;
+
+		SetScissor(top, bottom);
+	}
+
+	// Culls the triangle between three of the list's vertices if it's beyond
+	// the near or far plane, otherwise clips it to the screen and adds the
+	// result to the list. Only reads the rasteriser so any thread can do it.
+	void SetupTriangle(TriangleList & list, uint32_t a, uint32_t b, uint32_t c) const;
+
+	// Triangles have to have been through SetupTriangle
+	void DrawTriangle(const TriangleList & list, std::size_t triangle);
 	void DrawLine(int x1, int y1, int x2, int y2, const Colour & colour);
 
 private:
+	void DrawTriangle(const std::array<VertexShaderOutput, 3> & triangle);
 	void DrawTriangle(const FragmentShader & fragmentShader,
 		Real x1, Real y1, Real x2, Real y2, Real x3, Real y3);
 	void DrawWireFrameTriangle(const std::array<VertexShaderOutput, 3> & triangle);
 
-	bool ShouldCull(const std::array<VertexShaderOutput, 3> & triangle);
-
 	FrameBuffer *m_pFrame;
 	RenderMode m_mode;
+	unsigned m_left;
+	unsigned m_top;
+	unsigned m_right;
+	unsigned m_bottom;
 	Vector3 m_lightPosition;
+	Colour m_tint = Colour::White;
 	ShadyObject * m_fragmentShader;
 };
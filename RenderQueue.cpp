@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "RenderQueue.h"
+
+namespace
+{
+	// from the top: pass, vertex shader, fragment shader, depth
+	const unsigned PassBits = 8;
+	const unsigned ShaderBits = 12;
+
+	const unsigned DepthShift = 0;
+	const unsigned FragmentShift = 32;
+	const unsigned VertexShift = FragmentShift + ShaderBits;
+	const unsigned PassShift = VertexShift + ShaderBits;
+
+	static_assert(PassShift + PassBits <= 64, "sort key doesn't fit");
+}
+
+void RenderQueue::Clear()
+{
+	m_items.clear();
+	m_keys.clear();
+	m_vertexShaders.clear();
+	m_fragmentShaders.clear();
+}
+
+uint32_t RenderQueue::ShaderId(ArenaVector<ShadyObject*> & shaders, ShadyObject * shader)
+{
+	auto iter = std::find(shaders.begin(), shaders.end(), shader);
+
+	if (iter != shaders.end())
+		return static_cast<uint32_t>(iter - shaders.begin());
+
+	assert(shaders.size() < (1u << ShaderBits));
+
+	shaders.push_back(shader);
+
+	return static_cast<uint32_t>(shaders.size() - 1);
+}
+
+void RenderQueue::Add(const DrawItem & item, Real depth)
+{
+	assert(item.m_pass < (1u << PassBits));
+
+	// the bits of a positive float sort the same way as its value
+	depth = std::max(depth, 0.0f);
+
+	uint32_t depthBits;
+	std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	const uint64_t key =
+		(static_cast<uint64_t>(item.m_pass) << PassShift) |
+		(static_cast<uint64_t>(ShaderId(m_vertexShaders, item.m_vertexShader)) << VertexShift) |
+		(static_cast<uint64_t>(ShaderId(m_fragmentShaders, item.m_fragmentShader)) << FragmentShift) |
+		(static_cast<uint64_t>(depthBits) << DepthShift);
+
+	m_keys.push_back({ key, static_cast<uint32_t>(m_items.size()) });
+	m_items.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	// least significant digit first radix sort a byte at a time, stable so
+	// each byte keeps the order the lower ones put things in
+	const std::size_t count = m_keys.size();
+
+	m_scratch.resize(count);
+
+	for (unsigned shift = 0; shift < 64; shift += 8)
+	{
+		std::size_t offsets[256] = {};
+
+		for (auto && key : m_keys)
+			++offsets[(key.m_key >> shift) & 0xFF];
+
+		// most bytes are the same for every item (few shaders and passes)
+		// and don't need moving
+		if (std::find(std::begin(offsets), std::end(offsets), count) != std::end(offsets))
+			continue;
+
+		std::size_t total = 0;
+
+		for (auto && offset : offsets)
+		{
+			const std::size_t n = offset;
+			offset = total;
+			total += n;
+		}
+
+		for (auto && key : m_keys)
+			m_scratch[offsets[(key.m_key >> shift) & 0xFF]++] = key;
+
+		m_keys.swap(m_scratch);
+	}
+}
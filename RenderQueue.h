@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include "FrameArena.h"
+#include "Geometry.h"
+#include "Types.h"
+
+class ShadyObject;
+
+// One pass of one instance of an object, at the level of detail it was given
+struct DrawItem
+{
+	geometry::Object * m_object;
+	uint32_t m_instance;
+	uint32_t m_pass;
+	uint32_t m_level;
+	ShadyObject * m_vertexShader;
+	ShadyObject * m_fragmentShader;
+};
+
+// The draws for a frame in the order that changes shaders least. Items are
+// sorted by pass, then vertex shader, then fragment shader and then front to
+// back so that the depth test throws away as much as it can. A queue is built
+// afresh every frame so it lives in the frame arena.
+class RenderQueue
+{
+public:
+	void Clear();
+
+	// depth is the distance in front of the camera, anything behind it is
+	// treated as 0
+	void Add(const DrawItem & item, Real depth);
+
+	void Sort();
+
+	// In sorted order once Sort has been called
+	std::size_t GetNumItems() const { return m_items.size(); }
+	const DrawItem & GetItem(std::size_t index) const { return m_items[m_keys[index].m_item]; }
+
+private:
+	// Shaders get small numbers in the order they turn up so that they fit
+	// in the key
+	uint32_t ShaderId(ArenaVector<ShadyObject*> & shaders, ShadyObject * shader);
+
+private:
+	struct Key
+	{
+		uint64_t m_key;
+		uint32_t m_item;
+	};
+
+	ArenaVector<DrawItem> m_items;
+	ArenaVector<Key> m_keys;
+	ArenaVector<Key> m_scratch;
+	ArenaVector<ShadyObject*> m_vertexShaders;
+	ArenaVector<ShadyObject*> m_fragmentShaders;
+};
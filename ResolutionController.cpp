@@ -0,0 +1,40 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "ResolutionController.h"
+
+namespace
+{
+	// what a frame is aimed at, under the budget to leave room for noise
+	const double Target = 0.85;
+
+	// frames between here and the budget leave the scale alone
+	const double RaiseBelow = 0.7;
+
+	const double MaxRaise = 1.05;
+}
+
+ResolutionController::ResolutionController(double budgetMilliseconds, Real minScale)
+	: m_budget(budgetMilliseconds)
+	, m_minScale(minScale)
+{
+	assert(minScale > 0.0f && minScale <= 1.0f);
+}
+
+void ResolutionController::FrameFinished(double milliseconds)
+{
+	if (milliseconds <= 0.0)
+		return;
+
+	const double target = m_budget * Target;
+
+	// how much the scale on each axis would have to change to hit the target
+	const double change = std::sqrt(target / milliseconds);
+
+	if (milliseconds > m_budget)
+		m_scale = static_cast<Real>(m_scale * change);
+	else if (milliseconds < m_budget * RaiseBelow)
+		m_scale = static_cast<Real>(m_scale * std::min(change, MaxRaise));
+
+	m_scale = std::min(std::max(m_scale, m_minScale), 1.0f);
+}
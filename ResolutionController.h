@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Types.h"
+
+// Picks the resolution to draw at from how long the last frames took, so
+// that frames keep to a time budget. Most of a frame's cost is per pixel
+// and pixels go with the square of the scale.
+//
+// Going over the budget drops the scale straight to where the frame should
+// have fit, a spike is dealt with by the next frame. Coming back up is a
+// few percent a frame so that it doesn't overshoot and swing back down.
+class ResolutionController
+{
+public:
+	// The scale is for each axis and is never below minScale
+	ResolutionController(double budgetMilliseconds, Real minScale);
+
+	Real GetScale() const { return m_scale; }
+
+	// How long the frame drawn at GetScale took
+	void FrameFinished(double milliseconds);
+
+private:
+	double m_budget;
+	Real m_minScale;
+	Real m_scale = 1.0f;
+};
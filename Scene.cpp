@@ -1,5 +1,9 @@
+#include <algorithm>
+#include "AllocationCounter.h"
 #include "Scene.h"
 #include "scenes\BouncingCube.h"
+#include "scenes\BunnyCrowd.h"
+#include "scenes\CubeField.h"
 #include "scenes\SpinningCube.h"
 #include "scenes\SpinningSphere.h"
 #include "scenes\Bunny.h"
@@ -12,4 +16,32 @@ SceneDriver::SceneDriver()
 	m_scenes.emplace_back(new scene::BouncingCube());
 	m_scenes.emplace_back(new scene::Bunny());
 	m_scenes.emplace_back(new scene::Teapot());
+	m_scenes.emplace_back(new scene::CubeField());
+	m_scenes.emplace_back(new scene::BunnyCrowd());
+}
+
+void SceneDriver::UpdateHierarchy()
+{
+	ObjectIterator iterator = m_scenes[m_cursor]->GetObjects();
+
+	const ArenaVector<geometry::Object*> & objects = iterator.GetAll();
+
+	// a different set of objects (e.g. the scene changed) needs a new tree,
+	// otherwise the existing one is refitted to wherever the objects moved
+	if (objects.size() != m_sceneObjects.size() ||
+		! std::equal(objects.begin(), objects.end(), m_sceneObjects.begin()))
+	{
+		// only happens when the scene changes
+		AllocationCounter::Allow allow;
+
+		m_sceneObjects.assign(objects.begin(), objects.end());
+		m_hierarchy.Build(m_sceneObjects);
+
+		// culling can't find more than every object
+		m_visible.reserve(m_sceneObjects.size());
+	}
+	else
+	{
+		m_hierarchy.Update();
+	}
 }
@@ -1,16 +1,26 @@
 #pragma once
 
 #include <chrono>
+#include <initializer_list>
 #include <memory>
+#include "BoundingVolumeHierarchy.h"
+#include "FrameArena.h"
+#include "Frustum.h"
 #include "Geometry.h"
 
+// Iterators are made every frame so their copy of the list is kept in the
+// frame arena
 class ObjectIterator
 {
 public:
-	ObjectIterator(const std::vector<geometry::Object*> & objects)
+	ObjectIterator(std::initializer_list<geometry::Object*> objects)
 		: m_objects(objects)
 	{ }
 
+	ObjectIterator(const std::vector<geometry::Object*> & objects)
+		: m_objects(objects.begin(), objects.end())
+	{ }
+
 	bool HasMore() const
 	{
 		return m_cursor < m_objects.size();
@@ -22,8 +32,13 @@ public:
 		return m_objects[m_cursor++];
 	}
 
+	const ArenaVector<geometry::Object*> & GetAll() const
+	{
+		return m_objects;
+	}
+
 private:
-	std::vector<geometry::Object*> m_objects;
+	ArenaVector<geometry::Object*> m_objects;
 	std::size_t m_cursor = 0;
 };
 
@@ -43,12 +58,21 @@ public:
 	void Update(bool paused)
 	{
 		std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+
+		// nothing may have been drawn for a long time while paused, the
+		// scene carries on from where it stopped rather than jumping ahead
+		if (m_paused && ! paused)
+			m_lastTime = time;
+
 		long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(time - m_lastTime).count();
 
 		if (! paused)
 			m_scenes[m_cursor]->Update(ms);
 
 		m_lastTime = time;
+		m_paused = paused;
+
+		UpdateHierarchy();
 	}
 
 	ObjectIterator GetObjects()
@@ -56,14 +80,41 @@ public:
 		return m_scenes[m_cursor]->GetObjects();
 	}
 
+	// Only the objects whose bounds reach into the frustum
+	ObjectIterator GetVisibleObjects(const Frustum & frustum)
+	{
+		m_visible.clear();
+		m_hierarchy.Cull(frustum, m_visible);
+
+		return ObjectIterator(m_visible);
+	}
+
+	geometry::Object * Pick(const Vector3 & origin, const Vector3 & direction) const
+	{
+		return m_hierarchy.Pick(origin, direction);
+	}
+
+	std::size_t GetNumObjects() const
+	{
+		return m_hierarchy.GetNumObjects();
+	}
+
 	void Next()
 	{
 		if (++m_cursor == m_scenes.size())
 			m_cursor = 0;
 	}
 
+private:
+	void UpdateHierarchy();
+
 private:
 	std::vector<std::unique_ptr<IScene>> m_scenes;
 	std::size_t m_cursor = 0;
 	std::chrono::steady_clock::time_point m_lastTime = std::chrono::steady_clock::now();
+	bool m_paused = false;
+
+	BoundingVolumeHierarchy m_hierarchy;
+	std::vector<geometry::Object*> m_sceneObjects;
+	std::vector<geometry::Object*> m_visible;
 };
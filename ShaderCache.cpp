@@ -1,4 +1,5 @@
 #include <fstream>
+#include "AllocationCounter.h"
 #include "ShaderCache.h"
 #include "ShaderCompiler.h"
 
@@ -10,6 +11,8 @@ ShaderCache & ShaderCache::Get()
 
 ShadyObject * ShaderCache::GetVertexShader(const std::string & filename)
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	auto iter = m_vertexShaders.find(filename);
 
 	if (iter != m_vertexShaders.end())
@@ -20,21 +23,19 @@ ShadyObject * ShaderCache::GetVertexShader(const std::string & filename)
 	std::string source{ std::istreambuf_iterator<char>(file),
 		std::istreambuf_iterator<char>() };
 
-	std::string error;
-	ShaderCompiler compiler;
-
-	std::unique_ptr<ShadyObject> object = compiler.CompileVertexShader(source, error);
-
-	assert(error.empty());
+	std::unique_ptr<ShadyObject> object = Compile(source, true);
 
 	ShadyObject * r = object.get();
 	m_vertexShaders.emplace(filename, std::move(object));
+	m_sources.emplace(r, Source{ std::move(source), true });
 
 	return r;
 }
 
 ShadyObject * ShaderCache::GetFragmentShader(const std::string & filename)
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	auto iter = m_fragmentShaders.find(filename);
 
 	if (iter != m_fragmentShaders.end())
@@ -45,15 +46,59 @@ ShadyObject * ShaderCache::GetFragmentShader(const std::string & filename)
 	std::string source{ std::istreambuf_iterator<char>(file),
 		std::istreambuf_iterator<char>() };
 
+	std::unique_ptr<ShadyObject> object = Compile(source, false);
+
+	ShadyObject * r = object.get();
+	m_fragmentShaders.emplace(filename, std::move(object));
+	m_sources.emplace(r, Source{ std::move(source), false });
+
+	return r;
+}
+
+ShadyObject * ShaderCache::GetThreadInstance(ShadyObject * shader, unsigned thread)
+{
+	if (thread == 0)
+		return shader;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto existing = m_threadInstances.find(shader);
+
+	if (existing != m_threadInstances.end() && existing->second.size() >= thread && existing->second[thread - 1])
+		return existing->second[thread - 1].get();
+
+	// compiling happens once per shader and thread
+	AllocationCounter::Allow allow;
+
+	std::vector<std::unique_ptr<ShadyObject>> & instances = m_threadInstances[shader];
+
+	if (instances.size() < thread)
+		instances.resize(thread);
+
+	std::unique_ptr<ShadyObject> & instance = instances[thread - 1];
+
+	if (! instance)
+	{
+		auto source = m_sources.find(shader);
+
+		assert(source != m_sources.end());
+
+		instance = Compile(source->second.m_text, source->second.m_vertex);
+	}
+
+	return instance.get();
+}
+
+std::unique_ptr<ShadyObject> ShaderCache::Compile(const std::string & source, bool vertex)
+{
 	std::string error;
 	ShaderCompiler compiler;
 
-	std::unique_ptr<ShadyObject> object = compiler.CompileFragmentShader(source, error);
+	std::unique_ptr<ShadyObject> object = vertex
+		? compiler.CompileVertexShader(source, error)
+		: compiler.CompileFragmentShader(source, error);
 
 	assert(error.empty());
 
-	ShadyObject * r = object.get();
-	m_fragmentShaders.emplace(filename, std::move(object));
-
-	return r;
+	return object;
 }
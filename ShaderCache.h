@@ -1,7 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 class ShadyObject;
 
@@ -23,7 +26,27 @@ public:
 		return GetFragmentShader("fragment.shader");
 	}
 
+	// The same shader compiled again for another thread. Generated code keeps
+	// its globals at fixed addresses so two threads can't run one copy at
+	// once. Thread 0 gets the shader itself, the others are compiled the
+	// first time they're asked for.
+	ShadyObject * GetThreadInstance(ShadyObject * shader, unsigned thread);
+
+private:
+	std::unique_ptr<ShadyObject> Compile(const std::string & source, bool vertex);
+
 private:
+	struct Source
+	{
+		std::string m_text;
+		bool m_vertex;
+	};
+
+	// shaders are looked up from job threads so everything is behind this
+	std::mutex m_mutex;
+
 	std::unordered_map<std::string, std::unique_ptr<ShadyObject>> m_vertexShaders;
 	std::unordered_map<std::string, std::unique_ptr<ShadyObject>> m_fragmentShaders;
+	std::unordered_map<ShadyObject*, Source> m_sources;
+	std::unordered_map<ShadyObject*, std::vector<std::unique_ptr<ShadyObject>>> m_threadInstances;
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <emmintrin.h>
+
+// Shuffles shared by the SSE2 and AVX2 kernels in SimdMath. They are in an
+// unnamed namespace on purpose: each kernel file is built for a different
+// instruction set and one shared copy of an inline function could otherwise
+// be linked into the SSE2 path with AVX encodings in it.
+namespace
+{
+	// Four packed xyz triples into one register per component
+	inline void LoadXYZ(const float * p, __m128 & x, __m128 & y, __m128 & z)
+	{
+		const __m128 a = _mm_loadu_ps(p);     // x0 y0 z0 x1
+		const __m128 b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+		const __m128 c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+
+		const __m128 t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)); // x2 y2 z2 x3
+
+		x = _mm_shuffle_ps(a, t, _MM_SHUFFLE(3, 0, 3, 0));
+
+		y = _mm_shuffle_ps(
+			_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 2, 1)),  // y0 z0 y1 y1
+			_mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),  // y2 y2 y3 y3
+			_MM_SHUFFLE(2, 0, 2, 0));
+
+		z = _mm_shuffle_ps(
+			_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),  // z0 z0 z1 z1
+			_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),  // z2 z2 z3 z3
+			_MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	// The reverse of LoadXYZ. Each 16 byte store spills into the next triple
+	// which is written straight after, so only the last one is stored short.
+	inline void StoreXYZ(float * p, __m128 x, __m128 y, __m128 z)
+	{
+		__m128 w = _mm_setzero_ps();
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		_mm_storeu_ps(p, x);
+		_mm_storeu_ps(p + 3, y);
+		_mm_storeu_ps(p + 6, z);
+		_mm_storel_pi(reinterpret_cast<__m64*>(p + 9), w);
+		_mm_store_ss(p + 11, _mm_movehl_ps(w, w));
+	}
+
+	inline float HorizontalMin(__m128 v)
+	{
+		v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+		v = _mm_min_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+
+		return _mm_cvtss_f32(v);
+	}
+
+	inline float HorizontalMax(__m128 v)
+	{
+		v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+		v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+
+		return _mm_cvtss_f32(v);
+	}
+}
@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <intrin.h>
+#include "SimdHelpers.h"
+#include "SimdMath.h"
+
+// The kernels work on plain floats, 16 a matrix (row by row), 3 a Vector3
+// and 4 a Vector4. The wide versions only handle whole groups of four or
+// eight and return how many they did, the scalar version does the rest.
+
+namespace simd
+{
+namespace avx2
+{
+	// in SimdMathAvx2.cpp, which is the only file built for AVX2
+	std::size_t TransformPoints(const float * matrix, const float * points, std::size_t count, float * out);
+	std::size_t TransformVectors(const float * matrix, const float * vectors, std::size_t count, float * out);
+	std::size_t NormaliseVectors(float * vectors, std::size_t count);
+	std::size_t ComputeBounds(const float * points, std::size_t count, float * min, float * max);
+}
+}
+
+namespace
+{
+	namespace scalar
+	{
+		std::size_t TransformPoints(const float * m, const float * points, std::size_t count, float * out)
+		{
+			for (std::size_t i = 0; i < count; ++i, points += 3, out += 4)
+			{
+				for (unsigned row = 0; row < 4; ++row)
+				{
+					const float * r = m + row * 4;
+
+					out[row] = r[0] * points[0] + r[1] * points[1] + r[2] * points[2] + r[3];
+				}
+			}
+
+			return count;
+		}
+
+		std::size_t TransformVectors(const float * m, const float * vectors, std::size_t count, float * out)
+		{
+			for (std::size_t i = 0; i < count; ++i, vectors += 3, out += 3)
+			{
+				// copied first so that vectors and out can be the same
+				const float x = vectors[0];
+				const float y = vectors[1];
+				const float z = vectors[2];
+
+				for (unsigned row = 0; row < 3; ++row)
+				{
+					const float * r = m + row * 4;
+
+					out[row] = r[0] * x + r[1] * y + r[2] * z;
+				}
+			}
+
+			return count;
+		}
+
+		std::size_t NormaliseVectors(float * vectors, std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i, vectors += 3)
+			{
+				const float length = std::sqrt(vectors[0] * vectors[0] + vectors[1] * vectors[1] + vectors[2] * vectors[2]);
+
+				if (length > 0.0f)
+				{
+					vectors[0] /= length;
+					vectors[1] /= length;
+					vectors[2] /= length;
+				}
+			}
+
+			return count;
+		}
+
+		std::size_t ComputeBounds(const float * points, std::size_t count, float * min, float * max)
+		{
+			for (std::size_t i = 0; i < count; ++i, points += 3)
+			{
+				for (unsigned axis = 0; axis < 3; ++axis)
+				{
+					min[axis] = std::min(min[axis], points[axis]);
+					max[axis] = std::max(max[axis], points[axis]);
+				}
+			}
+
+			return count;
+		}
+	}
+
+	namespace sse2
+	{
+		std::size_t TransformPoints(const float * m, const float * points, std::size_t count, float * out)
+		{
+			std::size_t i = 0;
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 x, y, z;
+
+				LoadXYZ(points + i * 3, x, y, z);
+
+				// a row of the matrix gives one component of all four points
+				__m128 components[4];
+
+				for (unsigned row = 0; row < 4; ++row)
+				{
+					const float * r = m + row * 4;
+
+					components[row] = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[0]), x), _mm_mul_ps(_mm_set1_ps(r[1]), y)),
+						_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[2]), z), _mm_set1_ps(r[3])));
+				}
+
+				_MM_TRANSPOSE4_PS(components[0], components[1], components[2], components[3]);
+
+				for (unsigned j = 0; j < 4; ++j)
+					_mm_storeu_ps(out + (i + j) * 4, components[j]);
+			}
+
+			return i;
+		}
+
+		std::size_t TransformVectors(const float * m, const float * vectors, std::size_t count, float * out)
+		{
+			std::size_t i = 0;
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 x, y, z;
+
+				LoadXYZ(vectors + i * 3, x, y, z);
+
+				__m128 components[3];
+
+				for (unsigned row = 0; row < 3; ++row)
+				{
+					const float * r = m + row * 4;
+
+					components[row] = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[0]), x), _mm_mul_ps(_mm_set1_ps(r[1]), y)),
+						_mm_mul_ps(_mm_set1_ps(r[2]), z));
+				}
+
+				StoreXYZ(out + i * 3, components[0], components[1], components[2]);
+			}
+
+			return i;
+		}
+
+		std::size_t NormaliseVectors(float * vectors, std::size_t count)
+		{
+			const __m128 half = _mm_set1_ps(0.5f);
+			const __m128 three = _mm_set1_ps(3.0f);
+			const __m128 zero = _mm_setzero_ps();
+
+			std::size_t i = 0;
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 x, y, z;
+
+				LoadXYZ(vectors + i * 3, x, y, z);
+
+				const __m128 squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+
+				// the estimate is good to 12 bits, one Newton-Raphson step gets
+				// close to full precision
+				__m128 inverse = _mm_rsqrt_ps(squared);
+
+				inverse = _mm_mul_ps(_mm_mul_ps(half, inverse),
+					_mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(squared, inverse), inverse)));
+
+				// zero length vectors get a scale of one
+				const __m128 valid = _mm_cmpgt_ps(squared, zero);
+				const __m128 scale = _mm_or_ps(_mm_and_ps(valid, inverse), _mm_andnot_ps(valid, _mm_set1_ps(1.0f)));
+
+				StoreXYZ(vectors + i * 3, _mm_mul_ps(x, scale), _mm_mul_ps(y, scale), _mm_mul_ps(z, scale));
+			}
+
+			return i;
+		}
+
+		std::size_t ComputeBounds(const float * points, std::size_t count, float * min, float * max)
+		{
+			if (count < 4)
+				return 0;
+
+			__m128 minX = _mm_set1_ps(min[0]);
+			__m128 minY = _mm_set1_ps(min[1]);
+			__m128 minZ = _mm_set1_ps(min[2]);
+			__m128 maxX = _mm_set1_ps(max[0]);
+			__m128 maxY = _mm_set1_ps(max[1]);
+			__m128 maxZ = _mm_set1_ps(max[2]);
+
+			std::size_t i = 0;
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 x, y, z;
+
+				LoadXYZ(points + i * 3, x, y, z);
+
+				minX = _mm_min_ps(minX, x);
+				minY = _mm_min_ps(minY, y);
+				minZ = _mm_min_ps(minZ, z);
+				maxX = _mm_max_ps(maxX, x);
+				maxY = _mm_max_ps(maxY, y);
+				maxZ = _mm_max_ps(maxZ, z);
+			}
+
+			min[0] = HorizontalMin(minX);
+			min[1] = HorizontalMin(minY);
+			min[2] = HorizontalMin(minZ);
+			max[0] = HorizontalMax(maxX);
+			max[1] = HorizontalMax(maxY);
+			max[2] = HorizontalMax(maxZ);
+
+			return i;
+		}
+	}
+
+	struct Kernels
+	{
+		std::size_t (*m_transformPoints)(const float *, const float *, std::size_t, float *);
+		std::size_t (*m_transformVectors)(const float *, const float *, std::size_t, float *);
+		std::size_t (*m_normaliseVectors)(float *, std::size_t);
+		std::size_t (*m_computeBounds)(const float *, std::size_t, float *, float *);
+	};
+
+	const Kernels ScalarKernels =
+	{
+		scalar::TransformPoints,
+		scalar::TransformVectors,
+		scalar::NormaliseVectors,
+		scalar::ComputeBounds,
+	};
+
+	const Kernels Sse2Kernels =
+	{
+		sse2::TransformPoints,
+		sse2::TransformVectors,
+		sse2::NormaliseVectors,
+		sse2::ComputeBounds,
+	};
+
+	const Kernels Avx2Kernels =
+	{
+		simd::avx2::TransformPoints,
+		simd::avx2::TransformVectors,
+		simd::avx2::NormaliseVectors,
+		simd::avx2::ComputeBounds,
+	};
+
+	simd::InstructionSet Detect()
+	{
+		int info[4];
+
+		__cpuid(info, 0);
+
+		const int highestLeaf = info[0];
+
+		__cpuid(info, 1);
+
+		const bool sse2 = (info[3] & (1 << 26)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+
+		bool avx2 = false;
+
+		if (highestLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		// the OS has to save the ymm registers on a context switch too
+		if (avx && avx2 && fma && osxsave && (_xgetbv(0) & 6) == 6)
+			return simd::InstructionSet::AVX2;
+
+		if (sse2)
+			return simd::InstructionSet::SSE2;
+
+		return simd::InstructionSet::Scalar;
+	}
+
+	simd::InstructionSet g_instructionSet = simd::SupportedInstructionSet();
+
+	const Kernels & ActiveKernels()
+	{
+		switch (g_instructionSet)
+		{
+		case simd::InstructionSet::AVX2:
+			return Avx2Kernels;
+
+		case simd::InstructionSet::SSE2:
+			return Sse2Kernels;
+
+		default:
+			return ScalarKernels;
+		}
+	}
+}
+
+namespace simd
+{
+
+InstructionSet SupportedInstructionSet()
+{
+	static const InstructionSet supported = Detect();
+
+	return supported;
+}
+
+InstructionSet GetInstructionSet()
+{
+	return g_instructionSet;
+}
+
+void SetInstructionSet(InstructionSet instructionSet)
+{
+	g_instructionSet = std::min(instructionSet, SupportedInstructionSet());
+}
+
+void TransformPoints(const Matrix4 & matrix, const Vector3 * points, std::size_t count, Vector4 * out)
+{
+	const std::size_t done = ActiveKernels().m_transformPoints(matrix.Data(), &points->x, count, &out->x);
+
+	scalar::TransformPoints(matrix.Data(), &points[done].x, count - done, &out[done].x);
+}
+
+void TransformVectors(const Matrix4 & matrix, const Vector3 * vectors, std::size_t count, Vector3 * out)
+{
+	const std::size_t done = ActiveKernels().m_transformVectors(matrix.Data(), &vectors->x, count, &out->x);
+
+	scalar::TransformVectors(matrix.Data(), &vectors[done].x, count - done, &out[done].x);
+}
+
+void NormaliseVectors(Vector3 * vectors, std::size_t count)
+{
+	const std::size_t done = ActiveKernels().m_normaliseVectors(&vectors->x, count);
+
+	scalar::NormaliseVectors(&vectors[done].x, count - done);
+}
+
+void ComputeBounds(const Vector3 * points, std::size_t count, Vector3 & min, Vector3 & max)
+{
+	assert(count > 0);
+
+	min = max = points[0];
+
+	const std::size_t done = ActiveKernels().m_computeBounds(&points->x, count, &min.x, &max.x);
+
+	scalar::ComputeBounds(&points[done].x, count - done, &min.x, &max.x);
+}
+
+}
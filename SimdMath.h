@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include "Matrix.h"
+#include "Vector.h"
+
+// Kernels that run one operation over many vectors. Each has scalar, SSE2
+// and AVX2 versions and the widest one that the processor and OS support is
+// used.
+namespace simd
+{
+
+enum class InstructionSet
+{
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+// The best available, worked out once from cpuid. AVX2 also needs FMA and
+// the OS saving the upper halves of the registers.
+InstructionSet SupportedInstructionSet();
+
+InstructionSet GetInstructionSet();
+
+// Lets e.g. a benchmark compare the versions, anything above what is
+// supported is clamped to it
+void SetInstructionSet(InstructionSet instructionSet);
+
+// out[i] = matrix * (points[i], 1), nothing is divided by w
+void TransformPoints(const Matrix4 & matrix, const Vector3 * points, std::size_t count, Vector4 * out);
+
+// out[i] = matrix * (vectors[i], 0) so translations have no effect
+void TransformVectors(const Matrix4 & matrix, const Vector3 * vectors, std::size_t count, Vector3 * out);
+
+// In place, vectors of zero length are left alone
+void NormaliseVectors(Vector3 * vectors, std::size_t count);
+
+// Smallest box around count (at least one) points
+void ComputeBounds(const Vector3 * points, std::size_t count, Vector3 & min, Vector3 & max);
+
+}
@@ -0,0 +1,196 @@
+#include <cstddef>
+#include <immintrin.h>
+#include "SimdHelpers.h"
+
+// Built with /arch:AVX2, so nothing in here can use the inline functions
+// from Matrix.h or Vector.h: the linker keeps one copy of each and it could
+// be this one. SimdMath.cpp only calls in after checking cpuid.
+
+namespace
+{
+	// Eight packed xyz triples, the low lane has the first four
+	void LoadXYZ8(const float * p, __m256 & x, __m256 & y, __m256 & z)
+	{
+		__m128 x0, y0, z0;
+		__m128 x1, y1, z1;
+
+		LoadXYZ(p, x0, y0, z0);
+		LoadXYZ(p + 12, x1, y1, z1);
+
+		x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+		y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+		z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+	}
+
+	// _MM_TRANSPOSE4_PS on each lane separately
+	void Transpose4x2(__m256 & r0, __m256 & r1, __m256 & r2, __m256 & r3)
+	{
+		const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		const __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+		const __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+		const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+
+		r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	void StoreXYZ8(float * p, __m256 x, __m256 y, __m256 z)
+	{
+		StoreXYZ(p, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z));
+		StoreXYZ(p + 12, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+	}
+
+	float HorizontalMin8(__m256 v)
+	{
+		return HorizontalMin(_mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+	}
+
+	float HorizontalMax8(__m256 v)
+	{
+		return HorizontalMax(_mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+	}
+
+	__m256 Row(const float * r, __m256 x, __m256 y, __m256 z, __m256 w)
+	{
+		return _mm256_fmadd_ps(_mm256_set1_ps(r[0]), x,
+			_mm256_fmadd_ps(_mm256_set1_ps(r[1]), y,
+			_mm256_fmadd_ps(_mm256_set1_ps(r[2]), z, w)));
+	}
+}
+
+namespace simd
+{
+namespace avx2
+{
+
+std::size_t TransformPoints(const float * m, const float * points, std::size_t count, float * out)
+{
+	std::size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z;
+
+		LoadXYZ8(points + i * 3, x, y, z);
+
+		__m256 r0 = Row(m, x, y, z, _mm256_set1_ps(m[3]));
+		__m256 r1 = Row(m + 4, x, y, z, _mm256_set1_ps(m[7]));
+		__m256 r2 = Row(m + 8, x, y, z, _mm256_set1_ps(m[11]));
+		__m256 r3 = Row(m + 12, x, y, z, _mm256_set1_ps(m[15]));
+
+		// each lane now holds four whole points, the low halves of the rows
+		// are points 0-3 and the high halves 4-7
+		Transpose4x2(r0, r1, r2, r3);
+
+		float * p = out + i * 4;
+
+		_mm256_storeu_ps(p, _mm256_permute2f128_ps(r0, r1, 0x20));
+		_mm256_storeu_ps(p + 8, _mm256_permute2f128_ps(r2, r3, 0x20));
+		_mm256_storeu_ps(p + 16, _mm256_permute2f128_ps(r0, r1, 0x31));
+		_mm256_storeu_ps(p + 24, _mm256_permute2f128_ps(r2, r3, 0x31));
+	}
+
+	_mm256_zeroupper();
+
+	return i;
+}
+
+std::size_t TransformVectors(const float * m, const float * vectors, std::size_t count, float * out)
+{
+	const __m256 zero = _mm256_setzero_ps();
+
+	std::size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z;
+
+		LoadXYZ8(vectors + i * 3, x, y, z);
+
+		StoreXYZ8(out + i * 3,
+			Row(m, x, y, z, zero),
+			Row(m + 4, x, y, z, zero),
+			Row(m + 8, x, y, z, zero));
+	}
+
+	_mm256_zeroupper();
+
+	return i;
+}
+
+std::size_t NormaliseVectors(float * vectors, std::size_t count)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 three = _mm256_set1_ps(3.0f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	std::size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z;
+
+		LoadXYZ8(vectors + i * 3, x, y, z);
+
+		const __m256 squared = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z)));
+
+		__m256 inverse = _mm256_rsqrt_ps(squared);
+
+		inverse = _mm256_mul_ps(_mm256_mul_ps(half, inverse),
+			_mm256_fnmadd_ps(_mm256_mul_ps(squared, inverse), inverse, three));
+
+		const __m256 scale = _mm256_blendv_ps(one, inverse, _mm256_cmp_ps(squared, zero, _CMP_GT_OQ));
+
+		StoreXYZ8(vectors + i * 3, _mm256_mul_ps(x, scale), _mm256_mul_ps(y, scale), _mm256_mul_ps(z, scale));
+	}
+
+	_mm256_zeroupper();
+
+	return i;
+}
+
+std::size_t ComputeBounds(const float * points, std::size_t count, float * min, float * max)
+{
+	if (count < 8)
+		return 0;
+
+	__m256 minX = _mm256_set1_ps(min[0]);
+	__m256 minY = _mm256_set1_ps(min[1]);
+	__m256 minZ = _mm256_set1_ps(min[2]);
+	__m256 maxX = _mm256_set1_ps(max[0]);
+	__m256 maxY = _mm256_set1_ps(max[1]);
+	__m256 maxZ = _mm256_set1_ps(max[2]);
+
+	std::size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z;
+
+		LoadXYZ8(points + i * 3, x, y, z);
+
+		minX = _mm256_min_ps(minX, x);
+		minY = _mm256_min_ps(minY, y);
+		minZ = _mm256_min_ps(minZ, z);
+		maxX = _mm256_max_ps(maxX, x);
+		maxY = _mm256_max_ps(maxY, y);
+		maxZ = _mm256_max_ps(maxZ, z);
+	}
+
+	min[0] = HorizontalMin8(minX);
+	min[1] = HorizontalMin8(minY);
+	min[2] = HorizontalMin8(minZ);
+	max[0] = HorizontalMax8(maxX);
+	max[1] = HorizontalMax8(maxY);
+	max[2] = HorizontalMax8(maxZ);
+
+	_mm256_zeroupper();
+
+	return i;
+}
+
+}
+}
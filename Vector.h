@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <xmmintrin.h>
 #include "Types.h"
 
 class Vector3
@@ -34,9 +35,11 @@ public:
 
 	void Normalize()
 	{
-		x /= Length();
-		y /= Length();
-		z /= Length();
+		const Real length = Length();
+
+		x /= length;
+		y /= length;
+		z /= length;
 	}
 
 	Real Dot(const Vector3 & rhs) const
@@ -44,9 +47,20 @@ public:
 		return x * rhs.x + y * rhs.y + z * rhs.z;
 	}
 
+	Vector3 Cross(const Vector3 & rhs) const
+	{
+		return {
+			y * rhs.z - z * rhs.y,
+			z * rhs.x - x * rhs.z,
+			x * rhs.y - y * rhs.x
+		};
+	}
+
 	Vector3 NormalizedCopy() const
 	{
-		return { x / Length(), y / Length(), z / Length() };
+		const Real length = Length();
+
+		return { x / length, y / length, z / length };
 	}
 
 	Vector3 operator-() const
@@ -96,7 +110,10 @@ public:
 	}
 };
 
-class Vector4
+// Aligned so that it fills one SSE register. Heap memory on x86 is only 8
+// byte aligned (see AlignedAllocator.h) so the operators use unaligned loads
+// and stores, which cost nothing extra when the data does happen to be aligned.
+class alignas(16) Vector4
 {
 public:
 	Real x;
@@ -122,4 +139,42 @@ public:
 	{
 		return { x, y, z };
 	}
+
+	Real Dot(const Vector4 & rhs) const
+	{
+		__m128 product = _mm_mul_ps(Load(), rhs.Load());
+
+		// add the two halves and then the two quarters that are left
+		product = _mm_add_ps(product, _mm_movehl_ps(product, product));
+		product = _mm_add_ss(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1)));
+
+		return _mm_cvtss_f32(product);
+	}
+
+	Vector4 operator+(const Vector4 & rhs) const
+	{
+		return FromRegister(_mm_add_ps(Load(), rhs.Load()));
+	}
+
+	Vector4 operator-(const Vector4 & rhs) const
+	{
+		return FromRegister(_mm_sub_ps(Load(), rhs.Load()));
+	}
+
+	Vector4 operator*(Real scalar) const
+	{
+		return FromRegister(_mm_mul_ps(Load(), _mm_set1_ps(scalar)));
+	}
+
+	__m128 Load() const
+	{
+		return _mm_loadu_ps(&x);
+	}
+
+	static Vector4 FromRegister(__m128 value)
+	{
+		Vector4 v;
+		_mm_storeu_ps(&v.x, value);
+		return v;
+	}
 };
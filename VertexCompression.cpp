@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <emmintrin.h>
+#include "SimdMath.h"
+#include "VertexCompression.h"
+
+namespace
+{
+	const Real NormalScale = 32767.0f;
+
+	int16_t ToSnorm16(Real value)
+	{
+		value = std::min(std::max(value, -1.0f), 1.0f);
+
+		return static_cast<int16_t>(std::floor(value * NormalScale + 0.5f));
+	}
+
+	Real SignNotZero(Real value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	void EncodeNormal(const Vector3 & normal, int16_t & u, int16_t & v)
+	{
+		const Real l1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+
+		// a zero normal comes back as +z, there's nothing better to give it
+		if (l1 == 0.0f)
+		{
+			u = v = 0;
+			return;
+		}
+
+		// onto the octahedron |x| + |y| + |z| = 1, the lower half is folded
+		// out over the corners of the square
+		Real x = normal.x / l1;
+		Real y = normal.y / l1;
+
+		if (normal.z < 0.0f)
+		{
+			const Real folded = (1.0f - std::fabs(y)) * SignNotZero(x);
+			y = (1.0f - std::fabs(x)) * SignNotZero(y);
+			x = folded;
+		}
+
+		u = ToSnorm16(x);
+		v = ToSnorm16(y);
+	}
+
+	// Scalar version of the decode below for the last few vertices
+	void DecompressVertex(const geometry::CompressedVertices & vertices, uint32_t index,
+		Vector3 * position, Vector3 * normal)
+	{
+		position->x = vertices.m_origin.x + vertices.m_x[index] * vertices.m_step.x;
+		position->y = vertices.m_origin.y + vertices.m_y[index] * vertices.m_step.y;
+		position->z = vertices.m_origin.z + vertices.m_z[index] * vertices.m_step.z;
+
+		if (! normal)
+			return;
+
+		Real x = vertices.m_normalU[index] / NormalScale;
+		Real y = vertices.m_normalV[index] / NormalScale;
+		const Real z = 1.0f - std::fabs(x) - std::fabs(y);
+
+		const Real t = std::max(-z, 0.0f);
+
+		x -= std::copysign(t, x);
+		y -= std::copysign(t, y);
+
+		const Real length = std::sqrt(x * x + y * y + z * z);
+
+		*normal = { x / length, y / length, z / length };
+	}
+
+	// Writes four xyz triples from the x, y and z lanes, the stores overlap
+	// the next element which is written straight after
+	void StoreFour(Vector3 * out, __m128 x, __m128 y, __m128 z)
+	{
+		__m128 w = _mm_setzero_ps();
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		_mm_storeu_ps(&out[0].x, x);
+		_mm_storeu_ps(&out[1].x, y);
+		_mm_storeu_ps(&out[2].x, z);
+		_mm_storel_pi(reinterpret_cast<__m64*>(&out[3].x), w);
+		_mm_store_ss(&out[3].z, _mm_movehl_ps(w, w));
+	}
+
+	class Decoder
+	{
+	public:
+		Decoder(const geometry::CompressedVertices & vertices)
+			: m_originX(_mm_set1_ps(vertices.m_origin.x))
+			, m_originY(_mm_set1_ps(vertices.m_origin.y))
+			, m_originZ(_mm_set1_ps(vertices.m_origin.z))
+			, m_stepX(_mm_set1_ps(vertices.m_step.x))
+			, m_stepY(_mm_set1_ps(vertices.m_step.y))
+			, m_stepZ(_mm_set1_ps(vertices.m_step.z))
+		{ }
+
+		// Quantised values arrive as four 32 bit integers
+		void Decode(__m128i qx, __m128i qy, __m128i qz, Vector3 * positions) const
+		{
+			const __m128 x = _mm_add_ps(m_originX, _mm_mul_ps(_mm_cvtepi32_ps(qx), m_stepX));
+			const __m128 y = _mm_add_ps(m_originY, _mm_mul_ps(_mm_cvtepi32_ps(qy), m_stepY));
+			const __m128 z = _mm_add_ps(m_originZ, _mm_mul_ps(_mm_cvtepi32_ps(qz), m_stepZ));
+
+			StoreFour(positions, x, y, z);
+		}
+
+		void Decode(__m128i qu, __m128i qv, Vector3 * normals) const
+		{
+			const __m128 scale = _mm_set1_ps(1.0f / NormalScale);
+			const __m128 sign = _mm_set1_ps(-0.0f);
+			const __m128 one = _mm_set1_ps(1.0f);
+
+			__m128 x = _mm_mul_ps(_mm_cvtepi32_ps(qu), scale);
+			__m128 y = _mm_mul_ps(_mm_cvtepi32_ps(qv), scale);
+
+			const __m128 z = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(sign, x)), _mm_andnot_ps(sign, y));
+
+			// unfold the lower half, t is zero for the upper half so nothing
+			// needs a branch
+			const __m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+
+			x = _mm_sub_ps(x, _mm_or_ps(t, _mm_and_ps(sign, x)));
+			y = _mm_sub_ps(y, _mm_or_ps(t, _mm_and_ps(sign, y)));
+
+			// the squared length is at least 1/3 so the estimate needs no
+			// guard, one Newton-Raphson step brings it to full precision
+			const __m128 squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+
+			__m128 inverse = _mm_rsqrt_ps(squared);
+
+			inverse = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), inverse),
+				_mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(squared, inverse), inverse)));
+
+			StoreFour(normals, _mm_mul_ps(x, inverse), _mm_mul_ps(y, inverse), _mm_mul_ps(z, inverse));
+		}
+
+	private:
+		__m128 m_originX;
+		__m128 m_originY;
+		__m128 m_originZ;
+		__m128 m_stepX;
+		__m128 m_stepY;
+		__m128 m_stepZ;
+	};
+
+	__m128i LoadUnsigned(const uint16_t * values)
+	{
+		return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values)), _mm_setzero_si128());
+	}
+
+	__m128i LoadSigned(const int16_t * values)
+	{
+		// into the top half of each lane and shifted back down to extend the sign
+		return _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(),
+			_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values))), 16);
+	}
+
+	template <typename T>
+	__m128i Gather(const std::vector<T> & values, const uint32_t * indices)
+	{
+		return _mm_setr_epi32(values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]]);
+	}
+}
+
+namespace geometry
+{
+
+CompressedVertices CompressVertices(ArrayView<Vector3> positions, ArrayView<Vector3> normals)
+{
+	assert(positions.size() == normals.size());
+
+	CompressedVertices vertices;
+
+	const std::size_t count = positions.size();
+
+	if (count == 0)
+		return vertices;
+
+	Vector3 min;
+	Vector3 max;
+
+	simd::ComputeBounds(positions.data(), count, min, max);
+
+	const Real Levels = 65535.0f;
+
+	vertices.m_origin = min;
+	vertices.m_step = (max - min) * (1.0f / Levels);
+
+	// a flat axis has a step of zero and every value quantises to 0
+	const Real inverseStep[3] = {
+		vertices.m_step.x > 0.0f ? 1.0f / vertices.m_step.x : 0.0f,
+		vertices.m_step.y > 0.0f ? 1.0f / vertices.m_step.y : 0.0f,
+		vertices.m_step.z > 0.0f ? 1.0f / vertices.m_step.z : 0.0f,
+	};
+
+	auto Quantise = [&](Real value, Real origin, Real inverse)
+	{
+		const Real steps = std::floor((value - origin) * inverse + 0.5f);
+
+		return static_cast<uint16_t>(std::min(std::max(steps, 0.0f), Levels));
+	};
+
+	vertices.m_x.resize(count);
+	vertices.m_y.resize(count);
+	vertices.m_z.resize(count);
+	vertices.m_normalU.resize(count);
+	vertices.m_normalV.resize(count);
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		vertices.m_x[i] = Quantise(positions[i].x, min.x, inverseStep[0]);
+		vertices.m_y[i] = Quantise(positions[i].y, min.y, inverseStep[1]);
+		vertices.m_z[i] = Quantise(positions[i].z, min.z, inverseStep[2]);
+
+		EncodeNormal(normals[i], vertices.m_normalU[i], vertices.m_normalV[i]);
+	}
+
+	return vertices;
+}
+
+void DecompressVertices(const CompressedVertices & vertices, uint32_t first, uint32_t count,
+	Vector3 * positions, Vector3 * normals)
+{
+	assert(first + count <= vertices.size());
+
+	const Decoder decoder(vertices);
+
+	uint32_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const uint32_t index = first + i;
+
+		decoder.Decode(
+			LoadUnsigned(&vertices.m_x[index]),
+			LoadUnsigned(&vertices.m_y[index]),
+			LoadUnsigned(&vertices.m_z[index]),
+			positions + i);
+
+		if (normals)
+		{
+			decoder.Decode(
+				LoadSigned(&vertices.m_normalU[index]),
+				LoadSigned(&vertices.m_normalV[index]),
+				normals + i);
+		}
+	}
+
+	for (; i < count; ++i)
+		DecompressVertex(vertices, first + i, positions + i, normals ? normals + i : nullptr);
+}
+
+void DecompressIndexedVertices(const CompressedVertices & vertices, const uint32_t * indices, uint32_t count,
+	Vector3 * positions, Vector3 * normals)
+{
+	const Decoder decoder(vertices);
+
+	uint32_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		decoder.Decode(
+			Gather(vertices.m_x, indices + i),
+			Gather(vertices.m_y, indices + i),
+			Gather(vertices.m_z, indices + i),
+			positions + i);
+
+		if (normals)
+		{
+			decoder.Decode(
+				Gather(vertices.m_normalU, indices + i),
+				Gather(vertices.m_normalV, indices + i),
+				normals + i);
+		}
+	}
+
+	for (; i < count; ++i)
+		DecompressVertex(vertices, indices[i], positions + i, normals ? normals + i : nullptr);
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "ArrayView.h"
+#include "Types.h"
+#include "Vector.h"
+
+namespace geometry
+{
+
+// Vertex streams kept as a structure of arrays. Positions are quantised to
+// 16 bits across the mesh's bounding box and normals are octahedral encoded
+// (Meyer et al. 2010) into two signed 16 bit values, so a vertex is 10 bytes
+// instead of the 24 that two Vector3s take.
+struct CompressedVertices
+{
+	// position = m_origin + quantised * m_step
+	Vector3 m_origin;
+	Vector3 m_step;
+
+	std::vector<uint16_t> m_x;
+	std::vector<uint16_t> m_y;
+	std::vector<uint16_t> m_z;
+
+	std::vector<int16_t> m_normalU;
+	std::vector<int16_t> m_normalV;
+
+	std::size_t size() const { return m_x.size(); }
+};
+
+CompressedVertices CompressVertices(ArrayView<Vector3> positions, ArrayView<Vector3> normals);
+
+// Decodes count vertices from first onwards, four at a time with SSE2.
+// normals can be null when only the positions are wanted.
+void DecompressVertices(const CompressedVertices & vertices, uint32_t first, uint32_t count,
+	Vector3 * positions, Vector3 * normals);
+
+// As above for the vertices listed in indices, in that order
+void DecompressIndexedVertices(const CompressedVertices & vertices, const uint32_t * indices, uint32_t count,
+	Vector3 * positions, Vector3 * normals);
+
+}
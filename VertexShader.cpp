@@ -5,10 +5,46 @@
 
 VertexShader::VertexShader(const Projection & projection, ShadyObject * shader)
 	: m_projection(projection)
+	, m_projectionMatrix(projection.GetProjectionMatrix())
+	, m_modelTransform(Matrix4::Identity)
+	, m_viewTransform(Matrix4::Identity)
+	, m_precomputedModelView(Matrix4::Identity)
+	, m_normalMatrix(Matrix4::Identity)
 {
 	SetShader(shader);
 }
 
+void VertexShader::SetModelTransform(const Matrix4 & model)
+{
+	m_modelTransform = model;
+	ModelViewChanged();
+
+	if (m_shader)
+		m_g_model.Write(m_modelTransform);
+}
+
+void VertexShader::SetViewTransform(const Matrix4 & view)
+{
+	m_viewTransform = view;
+	ModelViewChanged();
+
+	if (m_shader)
+		m_g_view.Write(m_viewTransform);
+}
+
+void VertexShader::ModelViewChanged()
+{
+	m_precomputedModelView = m_viewTransform * m_modelTransform;
+
+	// an inverse per object is far cheaper than the shader multiplying view
+	// and model for every vertex, and unlike model-view itself it keeps
+	// normals at right angles to the surface under uneven scales
+	m_normalMatrix = m_precomputedModelView.NormalMatrix();
+
+	if (m_shader)
+		m_g_normal_matrix.Write(m_normalMatrix);
+}
+
 void VertexShader::SetShader(ShadyObject * shader)
 {
 	m_shader = shader;
@@ -17,9 +53,20 @@ void VertexShader::SetShader(ShadyObject * shader)
 	m_g_model = shader->GetGlobalLocation("g_model");
 	m_g_view = shader->GetGlobalLocation("g_view");
 	m_g_projection = shader->GetGlobalLocation("g_projection");
+	m_g_normal_matrix = shader->GetGlobalLocation("g_normal_matrix");
 	m_g_projected_position = shader->GetGlobalReader("g_projected_position");
 	m_g_world_position = shader->GetGlobalReader("g_world_position");
 	m_g_world_normal = shader->GetGlobalReader("g_world_normal");
+
+	WriteUniforms();
+}
+
+void VertexShader::WriteUniforms() const
+{
+	m_g_model.Write(m_modelTransform);
+	m_g_view.Write(m_viewTransform);
+	m_g_projection.Write(m_projectionMatrix);
+	m_g_normal_matrix.Write(m_normalMatrix);
 }
 
 VertexShaderOutput VertexShader::Execute(const Vector3 & vertex) const
@@ -40,9 +87,6 @@ VertexShaderOutput VertexShader::Execute(const Vector3 & vertex, const Vector3 &
 	{
 		m_g_position.Write(position4);
 		m_g_normal.Write(normal4);
-		m_g_model.Write(m_modelTransform);
-		m_g_view.Write(m_viewTransform);
-		m_g_projection.Write(m_projection.GetProjectionMatrix());
 
 		m_shader->Execute();
 
@@ -61,3 +105,34 @@ VertexShaderOutput VertexShader::Execute(const Vector3 & vertex, const Vector3 &
 
 	return output;
 }
+
+void VertexShader::ExecuteBatch(const Vector3 * vertices, const Vector3 * normals, uint32_t count,
+	VertexShaderOutput * outputs) const
+{
+	if (m_shader)
+	{
+		// the batch only streams xyz so w has to be set up front
+		m_g_position.Write(Vector4(0.0, 0.0, 0.0, 1.0));
+		m_g_normal.Write(Vector4(0.0, 0.0, 0.0, 0.0));
+
+		const uint32_t stride = sizeof(VertexShaderOutput);
+
+		// same order as the vertex shader context declares its streams
+		const ShadyObject::BatchStream streams[] =
+		{
+			{ const_cast<Vector3*>(vertices), sizeof(Vector3) },
+			{ const_cast<Vector3*>(normals), sizeof(Vector3) },
+			{ &outputs[0].m_projected, stride },
+			{ &outputs[0].m_position, stride },
+			{ &outputs[0].m_normal, stride },
+		};
+
+		m_shader->ExecuteBatch(count, streams);
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		outputs[i].m_screen.x = m_projection.ToScreenX(outputs[i].m_projected.x);
+		outputs[i].m_screen.y = m_projection.ToScreenY(outputs[i].m_projected.y);
+	}
+}
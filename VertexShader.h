@@ -1,5 +1,8 @@
 #pragma once
 
+#include <malloc.h>
+#include <new>
+#include "AllocationCounter.h"
 #include "Colour.h"
 #include "Matrix.h"
 #include "Point.h"
@@ -21,28 +24,50 @@ class VertexShader
 public:
 	VertexShader(const Projection & projection, ShadyObject * shader);
 
-	VertexShaderOutput Execute(const Vector3 & vertex) const;
-	VertexShaderOutput Execute(const Vector3 & vertex, const Vector3 & normal) const;
-
-	void SetModelTransform(const Matrix4 & model)
+	// The matrices are 16 byte aligned and new on x86 only promises 8
+	static void * operator new(std::size_t size)
 	{
-		m_modelTransform = model;
-		m_precomputedModelView = m_viewTransform * m_modelTransform;
+		AllocationCounter::Add();
+
+		void * memory = _aligned_malloc(size, alignof(Matrix4));
+
+		if (! memory)
+			throw std::bad_alloc();
+
+		return memory;
 	}
 
-	void SetViewTransform(const Matrix4 & view)
+	static void operator delete(void * pointer)
 	{
-		m_viewTransform = view;
-		m_precomputedModelView = m_viewTransform * m_modelTransform;
+		_aligned_free(pointer);
 	}
 
+	VertexShaderOutput Execute(const Vector3 & vertex) const;
+	VertexShaderOutput Execute(const Vector3 & vertex, const Vector3 & normal) const;
+
+	// Shades count vertices in one call into the generated code
+	void ExecuteBatch(const Vector3 * vertices, const Vector3 * normals, uint32_t count,
+		VertexShaderOutput * outputs) const;
+
+	// Uniforms are written into the shader as soon as they're set (and all of
+	// them again when the shader changes) so drawing another instance only
+	// costs the new model matrix rather than a full setup for every batch
+	void SetModelTransform(const Matrix4 & model);
+	void SetViewTransform(const Matrix4 & view);
+
 	void SetShader(ShadyObject * shader);
 
+private:
+	void ModelViewChanged();
+	void WriteUniforms() const;
+
 private:
 	const Projection & m_projection;
+	Matrix4 m_projectionMatrix;
 	Matrix4 m_modelTransform;
 	Matrix4 m_viewTransform;
 	Matrix4 m_precomputedModelView;
+	Matrix4 m_normalMatrix;
 	ShadyObject *m_shader;
 
 	ShadyObject::GlobalWriter m_g_position;
@@ -50,6 +75,7 @@ private:
 	ShadyObject::GlobalWriter m_g_model;
 	ShadyObject::GlobalWriter m_g_view;
 	ShadyObject::GlobalWriter m_g_projection;
+	ShadyObject::GlobalWriter m_g_normal_matrix;
 
 	ShadyObject::GlobalReader m_g_projected_position;
 	ShadyObject::GlobalReader m_g_world_position;
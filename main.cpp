@@ -1,26 +1,54 @@
 #include <array>
+#include <cassert>
 #include <chrono>
+#include <cstdio>
 #include <ctime>
-#include <string>
+#include <mutex>
 #include <Windows.h>
 
+#include "AlignedAllocator.h"
+#include "AllocationCounter.h"
 #include "Camera.h"
+#include "DamageTracker.h"
+#include "FrameArena.h"
 #include "FrameBuffer.h"
+#include "Frustum.h"
 #include "Geometry.h"
+#include "ImageWriter.h"
 #include "InputHandler.h"
+#include "JobSystem.h"
 #include "Matrix.h"
 #include "Projection.h"
 #include "Rasteriser.h"
-#include "ScopedHDC.h"
+#include "RenderQueue.h"
+#include "ResolutionController.h"
 #include "Scene.h"
 #include "ShaderCache.h"
+#include "SimdMath.h"
 #include "Vector.h"
+#include "VertexCompression.h"
 #include "VertexShader.h"
 
 namespace
 {
 	FrameBuffer *g_frame = nullptr;
 
+	// made with the frame buffer, the vertex shaders keep a reference to it
+	Projection *g_projection = nullptr;
+
+	// frames are drawn smaller than the window when they'd take longer than
+	// this, down to half the size on each axis
+	const double kFrameBudgetMilliseconds = 16.6;
+	const Real kMinResolutionScale = 0.5f;
+
+	ResolutionController g_resolution(kFrameBudgetMilliseconds, kMinResolutionScale);
+
+	DamageTracker g_damage;
+
+	// whether the last WM_PAINT wants another frame, the window isn't painted
+	// again until there's input once a paused frame has found nothing to draw
+	bool g_drawing = true;
+
 	Camera g_camera;
 
 	InputHandler g_inputHandler;
@@ -28,9 +56,67 @@ namespace
 	SceneDriver * g_sceneDriver;
 
 	int g_mx, g_my;
+
+	// a level of detail is used once its error covers less than this
+	const Real kLodPixelError = 1.0f;
+
+	bool g_pickPending = false;
+	int g_pickX, g_pickY;
+	geometry::Object * g_picked = nullptr;
+
+	std::size_t g_visibleObjects = 0;
+	std::size_t g_drawnInstances = 0;
+	long long g_cullMicroseconds = 0;
+
+	// draws set up by one job
+	const std::size_t kItemsPerJob = 4;
+
+	// a bucket's colour and depth should stay in the L2 cache
+	const unsigned kBucketSize = 128;
+
+	// 16K, written with R
+	const unsigned kPosterWidth = 15360;
+	const unsigned kPosterHeight = 8640;
+
+	// The vertex shader of one job thread, kept from frame to frame.
+	// Generated shaders keep their globals at fixed addresses so each thread
+	// binds its own copy.
+	struct ThreadShader
+	{
+		std::unique_ptr<VertexShader> m_vertexShader;
+
+		// the shared shader that m_vertexShader has a copy of bound
+		ShadyObject * m_bound = nullptr;
+	};
+
+	std::vector<ThreadShader> g_threadShaders;
+
+	// Space the draws set up on one thread work in, only for the frame
+	struct ThreadScratch
+	{
+		ArenaVector<uint32_t> m_visible;
+		ArenaVector<uint32_t> m_remap;
+		ArenaVector<uint32_t> m_gathered;
+		ArenaVector<Vector3> m_batchPositions;
+		ArenaVector<Vector3> m_batchNormals;
+	};
+
+	// A triangle of a set up draw that touches a bucket
+	struct BinnedTriangle
+	{
+		uint32_t m_item;
+		uint32_t m_triangle;
+	};
+
+#ifdef _DEBUG
+	// frames that may allocate while buffers find their size
+	const unsigned kWarmUpFrames = 2;
+
+	unsigned g_frames = 0;
+#endif
 }
 
-void FrameCount(HWND hwnd)
+void FrameCount(FrameBuffer & frame)
 {
 	static time_t t = time(NULL);
 	static unsigned count = 0;
@@ -48,109 +134,813 @@ void FrameCount(HWND hwnd)
 		++count;
 	}
 
-	std::string str = "FPS: " + std::to_string((unsigned long long)lastFps) +
-		" x=" + std::to_string(g_mx) + ", y=" + std::to_string(g_my);
+	// formatted on the stack, building strings would allocate every frame
+	char text[256];
+
+	std::snprintf(text, sizeof(text), "FPS: %u x=%d, y=%d objects=%u/%u instances=%u cull=%lldus %ux%u",
+		lastFps, g_mx, g_my,
+		static_cast<unsigned>(g_visibleObjects),
+		static_cast<unsigned>(g_sceneDriver->GetNumObjects()),
+		static_cast<unsigned>(g_drawnInstances),
+		g_cullMicroseconds,
+		frame.GetWidth(), frame.GetHeight());
+
+	// shown with the frame by the present thread
+	frame.SetOverlayText(text);
+}
+
+geometry::Object * Pick(const Projection & projection, const Matrix4 & view,
+	int x, int y, unsigned width, unsigned height)
+{
+	const Matrix4 projectionMatrix = projection.GetProjectionMatrix();
+
+	// back from the pixel to normalized device coordinates and then to a
+	// direction in view space on the near plane
+	const Real ndcX = (2.0f * x) / width - 1.0f;
+	const Real ndcY = 1.0f - (2.0f * y) / height;
+
+	const Vector4 direction = {
+		ndcX / projectionMatrix(0, 0),
+		ndcY / projectionMatrix(1, 1),
+		-1.0,
+		0.0 };
+
+	const Matrix4 inverseView = view.Inverse();
+
+	const Vector3 origin = (inverseView * Vector4(0.0, 0.0, 0.0, 1.0)).XYZ();
+
+	return g_sceneDriver->Pick(origin, (inverseView * direction).XYZ());
+}
+
+void DrawBox(Rasteriser & rasta, const Projection & projection, const Matrix4 & view,
+	const geometry::BoundingBox & box)
+{
+	const Matrix4 viewProjection = projection.GetProjectionMatrix() * view;
+
+	std::array<Vector3, 8> points;
+	std::array<Vector4, 8> corners;
+
+	for (unsigned i = 0; i < 8; ++i)
+	{
+		points[i] = {
+			(i & 1) ? box.m_max.x : box.m_min.x,
+			(i & 2) ? box.m_max.y : box.m_min.y,
+			(i & 4) ? box.m_max.z : box.m_min.z,
+		};
+	}
+
+	simd::TransformPoints(viewProjection, points.data(), points.size(), corners.data());
+
+	// not worth clipping the lines for a debug outline
+	for (auto && corner : corners)
+	{
+		if (corner.w <= 0.0f)
+			return;
+	}
+
+	for (unsigned i = 0; i < 8; ++i)
+	{
+		for (unsigned bit = 1; bit < 8; bit <<= 1)
+		{
+			const unsigned j = i | bit;
+
+			if (j == i)
+				continue;
 
-	ScopedHDC hdc(hwnd);
-	TextOut(hdc, 5, 5, str.c_str(), str.length());
+			rasta.DrawLine(
+				projection.ToScreenX(corners[i].x / corners[i].w),
+				projection.ToScreenY(corners[i].y / corners[i].w),
+				projection.ToScreenX(corners[j].x / corners[j].w),
+				projection.ToScreenY(corners[j].y / corners[j].w),
+				Colour::Red);
+		}
+	}
 }
 
-void RenderLoop(HWND hWnd, RenderMode mode, bool cull, bool drawNormals, bool paused)
+std::size_t SelectLod(const geometry::Object & object, const geometry::Instance & instance,
+	const Projection & projection, const Vector3 & camera)
 {
+	const geometry::BoundingSphere & local = object.GetBoundingSphere();
+	const geometry::BoundingSphere & world = instance.m_worldSphere;
+
+	// errors are in object space so they scale with the model matrix
+	const Real scale = local.m_radius > 0.0f ? world.m_radius / local.m_radius : 1.0f;
+
+	// the nearest the surface can be, inside the bounds nothing is simplified
+	const Real distance = (world.m_centre - camera).Length() - world.m_radius;
+
+	if (distance <= 0.0f)
+		return 0;
+
+	std::size_t level = 0;
+
+	for (std::size_t i = 1; i < object.GetNumLods(); ++i)
+	{
+		if (projection.ToScreenSize(object.GetLod(i).m_error * scale, distance) >= kLodPixelError)
+			break;
+
+		level = i;
+	}
+
+	return level;
+}
+
+// Culls, shades and sets up the triangles of one draw. Runs as a job so it
+// only touches its own thread's state and list.
+void SetupDraw(const DrawItem & item, ThreadShader & shader, ThreadScratch & scratch,
+	const Matrix4 & view, const Rasteriser & rasta, bool cull, bool drawNormals, TriangleList & list)
+{
+	list.Clear();
+
+	// the queue is sorted by shader so the thread's copy is rarely changed
+	if (item.m_vertexShader != shader.m_bound)
+	{
+		shader.m_vertexShader->SetShader(
+			ShaderCache::Get().GetThreadInstance(item.m_vertexShader, JobSystem::GetThreadIndex()));
+
+		shader.m_bound = item.m_vertexShader;
+	}
+
+	VertexShader & vertexShader = *shader.m_vertexShader;
+
+	const geometry::Object * object = item.m_object;
+	const geometry::Instance & instance = object->GetInstance(item.m_instance);
+
+	const bool reverseCull = object->ReverseCull(item.m_pass);
+
+	// either float streams or compressed ones, the other is empty
+	const auto positions = object->GetPositions();
+	const auto normals = object->GetNormals();
+	const geometry::CompressedVertices * compressed = object->GetCompressedVertices();
+
+	const uint32_t vertices = static_cast<uint32_t>(object->GetNumVertices());
+
+	vertexShader.SetModelTransform(instance.m_model);
+
+	// the camera is at the origin in view space, taking it back into
+	// object space lets faces be culled against the untransformed mesh
+	const Vector3 eye = ((view * instance.m_model).Inverse() * Vector4(0.0, 0.0, 0.0, 1.0)).XYZ();
+
+	const geometry::LevelOfDetail lod = object->GetLod(item.m_level);
+
+	const auto indices = lod.m_indices;
+	const auto planes = lod.m_facePlanes;
+
+	const std::size_t triangles = indices.size() / 3;
+
+	ArenaVector<uint32_t> & visible = scratch.m_visible;
+	ArenaVector<uint32_t> & remap = scratch.m_remap;
+
+	visible.clear();
+
+	for (uint32_t triangle = 0; triangle < triangles; ++triangle)
+	{
+		const geometry::FacePlane & plane = planes[triangle];
+
+		if (cull && (plane.m_normal.Dot(eye) > plane.m_distance) == reverseCull)
+			continue;
+
+		visible.push_back(triangle);
+	}
+
+	if (visible.empty())
+		return;
+
+	if (item.m_level == 0 && visible.size() == triangles)
+	{
+		// every vertex is used so shade the object's streams as they are
+		list.m_vertices.resize(vertices);
+
+		if (compressed)
+		{
+			scratch.m_batchPositions.resize(vertices);
+			scratch.m_batchNormals.resize(vertices);
+
+			geometry::DecompressVertices(*compressed, 0, vertices,
+				scratch.m_batchPositions.data(), scratch.m_batchNormals.data());
+
+			vertexShader.ExecuteBatch(scratch.m_batchPositions.data(), scratch.m_batchNormals.data(),
+				vertices, list.m_vertices.data());
+		}
+		else
+		{
+			vertexShader.ExecuteBatch(positions.data(), normals.data(),
+				vertices, list.m_vertices.data());
+		}
+
+		remap.resize(vertices);
+
+		for (uint32_t i = 0; i < remap.size(); ++i)
+			remap[i] = i;
+	}
+	else
+	{
+		// gather only the vertices that the visible faces use so back
+		// faces cost nothing in the vertex shader
+		const uint32_t unused = 0xFFFFFFFF;
+
+		ArenaVector<uint32_t> & gathered = scratch.m_gathered;
+
+		remap.assign(vertices, unused);
+		gathered.clear();
+
+		for (uint32_t triangle : visible)
+		{
+			for (unsigned i = 0; i < 3; ++i)
+			{
+				const uint32_t index = indices[triangle * 3 + i];
+
+				if (remap[index] != unused)
+					continue;
+
+				remap[index] = static_cast<uint32_t>(gathered.size());
+				gathered.push_back(index);
+			}
+		}
+
+		const uint32_t count = static_cast<uint32_t>(gathered.size());
+
+		scratch.m_batchPositions.resize(count);
+		scratch.m_batchNormals.resize(count);
+
+		if (compressed)
+		{
+			geometry::DecompressIndexedVertices(*compressed, gathered.data(), count,
+				scratch.m_batchPositions.data(), scratch.m_batchNormals.data());
+		}
+		else
+		{
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				scratch.m_batchPositions[i] = positions[gathered[i]];
+				scratch.m_batchNormals[i] = normals[gathered[i]];
+			}
+		}
+
+		list.m_vertices.resize(count);
+
+		vertexShader.ExecuteBatch(scratch.m_batchPositions.data(), scratch.m_batchNormals.data(),
+			count, list.m_vertices.data());
+	}
+
+	for (uint32_t triangle : visible)
+	{
+		rasta.SetupTriangle(list,
+			remap[indices[triangle * 3]],
+			remap[indices[triangle * 3 + 1]],
+			remap[indices[triangle * 3 + 2]]);
+
+		if (drawNormals)
+		{
+			for (unsigned i = 0; i < 3; ++i)
+			{
+				const uint32_t index = indices[triangle * 3 + i];
+
+				Vector3 start;
+				Vector3 normal;
+
+				if (compressed)
+				{
+					geometry::DecompressIndexedVertices(*compressed, &index, 1, &start, &normal);
+				}
+				else
+				{
+					start = positions[index];
+					normal = normals[index];
+				}
+
+				Vector3 end = start + (normal * 5.0);
+
+				list.m_lines.push_back(vertexShader.Execute(start).m_screen);
+				list.m_lines.push_back(vertexShader.Execute(end).m_screen);
+			}
+		}
+	}
+}
+
+// Draws every set up triangle that crosses columns left to right - 1 of rows
+// top to bottom - 1. Items are drawn in queue order so the bands put together
+// come out the same as drawing the whole frame on one thread.
+void DrawBand(const RenderQueue & queue, const ArenaVector<TriangleList> & lists, FrameBuffer * frame,
+	RenderMode mode, const Vector3 & light, unsigned left, unsigned top, unsigned right, unsigned bottom)
+{
+	const unsigned thread = JobSystem::GetThreadIndex();
+
+	// every item binds its fragment shader before anything is drawn
+	Rasteriser rasta(frame, mode, nullptr);
+
+	rasta.SetLightPosition(light);
+	rasta.SetScissor(left, top, right, bottom);
+
+	ShadyObject * bound = nullptr;
+
+	for (std::size_t n = 0; n < queue.GetNumItems(); ++n)
+	{
+		const DrawItem & item = queue.GetItem(n);
+		const TriangleList & list = lists[n];
+
+		if (list.m_indices.empty() && list.m_lines.empty())
+			continue;
+
+		if (item.m_fragmentShader != bound)
+		{
+			rasta.SetShader(ShaderCache::Get().GetThreadInstance(item.m_fragmentShader, thread));
+			bound = item.m_fragmentShader;
+		}
+
+		rasta.SetTint(item.m_object->GetInstance(item.m_instance).m_colour);
+
+		const std::size_t triangles = list.m_indices.size() / 3;
+
+		for (std::size_t triangle = 0; triangle < triangles; ++triangle)
+			rasta.DrawTriangle(list, triangle);
+
+		for (std::size_t i = 0; i < list.m_lines.size(); i += 2)
+		{
+			rasta.DrawLine(
+				list.m_lines[i].x, list.m_lines[i].y,
+				list.m_lines[i + 1].x, list.m_lines[i + 1].y,
+				Colour::Red);
+		}
+	}
+}
+
+// Scales and moves clip space so that the region of a width x height frame
+// fills it, a frustum made with this only has what reaches into the region
+Matrix4 CropToRegion(const DamageTracker::Region & region, unsigned width, unsigned height)
+{
+	// the edges in normalized device coordinates, y goes up
+	const Real left = (2.0f * region.m_left) / width - 1.0f;
+	const Real right = (2.0f * region.m_right) / width - 1.0f;
+	const Real top = 1.0f - (2.0f * region.m_top) / height;
+	const Real bottom = 1.0f - (2.0f * region.m_bottom) / height;
+
+	return {{{
+		{ 2.0f / (right - left), 0.0,                   0.0, -(right + left) / (right - left) },
+		{ 0.0,                   2.0f / (top - bottom), 0.0, -(top + bottom) / (top - bottom) },
+		{ 0.0,                   0.0,                   1.0, 0.0 },
+		{ 0.0,                   0.0,                   0.0, 1.0 }
+	}}};
+}
+
+// Looking these up by name would make a std::string every frame
+ShadyObject * DefaultVertexShader()
+{
+	static ShadyObject * const shader = ShaderCache::Get().DefaultVertexShader();
+	return shader;
+}
+
+ShadyObject * DefaultFragmentShader()
+{
+	static ShadyObject * const shader = ShaderCache::Get().DefaultFragmentShader();
+	return shader;
+}
+
+// Queues every pass of each instance of the objects that is in the frustum,
+// returns how many instances that was
+std::size_t QueueDraws(ObjectIterator & iterator, const Frustum & frustum, const Projection & projection,
+	const Matrix4 & view, RenderQueue & queue)
+{
+	const Vector3 camera = (view.Inverse() * Vector4(0.0, 0.0, 0.0, 1.0)).XYZ();
+
+	std::size_t drawn = 0;
+
+	while (iterator.HasMore())
+	{
+		geometry::Object * object = iterator.Next();
+
+		// the hierarchy only tested the bounds around every instance so each
+		// one still has to be checked on its own
+		const std::size_t instances = object->GetNumInstances();
+		const std::size_t passes = object->GetNumPasses();
+
+		for (std::size_t i = 0; i < instances; ++i)
+		{
+			const geometry::Instance & instance = object->GetInstance(i);
+
+			if (instances > 1 &&
+				!(frustum.Intersects(instance.m_worldSphere) && frustum.Intersects(instance.m_worldBox)))
+				continue;
+
+			++drawn;
+
+			const uint32_t level = static_cast<uint32_t>(SelectLod(*object, instance, projection, camera));
+
+			// the camera looks down -z, the front of the bounds is what the
+			// depth test cares about
+			const geometry::BoundingSphere & sphere = instance.m_worldSphere;
+			const Real depth = -(view * Vector4(sphere.m_centre.x, sphere.m_centre.y, sphere.m_centre.z, 1.0)).z - sphere.m_radius;
+
+			for (std::size_t pass = 0; pass < passes; ++pass)
+			{
+				// a pass without its own shader uses the default one
+				ShadyObject * vshader = object->VertexShader(pass);
+				ShadyObject * fshader = object->FragmentShader(pass);
+
+				const DrawItem item = {
+					object,
+					static_cast<uint32_t>(i),
+					static_cast<uint32_t>(pass),
+					level,
+					vshader ? vshader : DefaultVertexShader(),
+					fshader ? fshader : DefaultFragmentShader(),
+				};
+
+				queue.Add(item, depth);
+			}
+		}
+	}
+
+	return drawn;
+}
+
+// Sets up every item of the queue into its list as jobs that count down
+// prepared, everything passed has to outlive them
+void SetupDraws(const RenderQueue & queue, std::vector<ThreadShader> & shaders, ArenaVector<ThreadScratch> & scratch,
+	const Matrix4 & view, const Rasteriser & rasta, bool cull, bool drawNormals,
+	ArenaVector<TriangleList> & lists, JobCounter & prepared)
+{
+	const std::size_t items = queue.GetNumItems();
+
+	for (std::size_t first = 0; first < items; first += kItemsPerJob)
+	{
+		const std::size_t last = std::min(first + kItemsPerJob, items);
+
+		JobSystem::Get().Run([&, first, last]()
+		{
+			const unsigned thread = JobSystem::GetThreadIndex();
+
+			for (std::size_t n = first; n < last; ++n)
+			{
+				SetupDraw(queue.GetItem(n), shaders[thread], scratch[thread],
+					view, rasta, cull, drawNormals, lists[n]);
+			}
+		}, &prepared);
+	}
+}
+
+// Draws the triangles binned to the bucket between left, top and right,
+// bottom. The bin is in queue order so this is drawn the same as DrawBand.
+void DrawBucket(const RenderQueue & queue, const ArenaVector<TriangleList> & lists,
+	const std::vector<BinnedTriangle> & bin, FrameBuffer * frame, RenderMode mode, const Vector3 & light,
+	unsigned left, unsigned top, unsigned right, unsigned bottom)
+{
+	const unsigned thread = JobSystem::GetThreadIndex();
+
+	Rasteriser rasta(frame, mode, nullptr);
+
+	rasta.SetLightPosition(light);
+	rasta.SetScissor(left, top, right, bottom);
+
+	ShadyObject * bound = nullptr;
+	uint32_t current = 0xFFFFFFFF;
+
+	for (auto && binned : bin)
+	{
+		if (binned.m_item != current)
+		{
+			const DrawItem & item = queue.GetItem(binned.m_item);
+
+			if (item.m_fragmentShader != bound)
+			{
+				rasta.SetShader(ShaderCache::Get().GetThreadInstance(item.m_fragmentShader, thread));
+				bound = item.m_fragmentShader;
+			}
+
+			rasta.SetTint(item.m_object->GetInstance(item.m_instance).m_colour);
+			current = binned.m_item;
+		}
+
+		rasta.DrawTriangle(lists[binned.m_item], binned.m_triangle);
+	}
+}
+
+// Draws the part of the frame that has changed since the last one. Returns
+// whether another frame should follow, which it always should while the
+// scene is moving even if this one found nothing to draw.
+bool RenderLoop(HWND hWnd, RenderMode mode, bool cull, bool drawNormals, bool paused)
+{
+	const std::chrono::high_resolution_clock::time_point frameStart = std::chrono::high_resolution_clock::now();
+
 	if (g_frame == nullptr)
 	{
 		g_frame = new FrameBuffer(hWnd);
+		g_projection = new Projection(90.0f, 1.0f, 1000.0f, g_frame->GetWidth(), g_frame->GetHeight());
+	}
+
+	{
+		const Real scale = g_resolution.GetScale();
+
+		const unsigned renderWidth = std::max(2u, static_cast<unsigned>(g_frame->GetStoredWidth() * scale + 0.5f));
+		const unsigned renderHeight = std::max(2u, static_cast<unsigned>(g_frame->GetStoredHeight() * scale + 0.5f));
+
+		g_frame->SetRenderSize(renderWidth, renderHeight);
+		g_projection->SetScreenSize(renderWidth, renderHeight);
 	}
 
+	// nothing from the last frame is still running or kept
+	FrameArena::ResetAll();
+
+#ifdef _DEBUG
+	const std::size_t allocations = AllocationCounter::GetCount();
+#endif
+
 	FrameBuffer *pFrame = g_frame;
-	pFrame->Clear();
+	const Projection & projection = *g_projection;
 
-	Rasteriser rasta(pFrame, mode, ShaderCache::Get().DefaultFragmentShader());
+	JobSystem & jobs = JobSystem::Get();
 
-	Vector4 light { 0.0, 0.0, 0.0, 1.0 };
-	Vector3 lightViewSpace = (g_camera.GetTransform() * light).XYZ();
+	ShadyObject * const defaultVertexShader = DefaultVertexShader();
+	ShadyObject * const defaultFragmentShader = DefaultFragmentShader();
 
-	rasta.SetLightPosition(lightViewSpace);
+	if (g_threadShaders.empty())
+	{
+		g_threadShaders.resize(jobs.GetNumThreads());
+
+		for (unsigned thread = 0; thread < g_threadShaders.size(); ++thread)
+		{
+			g_threadShaders[thread].m_vertexShader.reset(new VertexShader(projection,
+				ShaderCache::Get().GetThreadInstance(defaultVertexShader, thread)));
+
+			g_threadShaders[thread].m_bound = defaultVertexShader;
+		}
+	}
+
+	Rasteriser rasta(pFrame, mode, defaultFragmentShader);
 
 	const unsigned width = pFrame->GetWidth();
 	const unsigned height = pFrame->GetHeight();
 
-	Projection projection(90.0f, 1.0f, 1000.0f, width, height);
+	// everything after depends on where the objects end up so there's
+	// nothing to run alongside it
+	g_sceneDriver->Update(paused);
 
-	VertexShader vertexShader(projection, ShaderCache::Get().DefaultVertexShader());
+	const Matrix4 view = g_camera.GetTransform();
 
-	g_sceneDriver->Update(paused);
+	if (g_pickPending)
+	{
+		// testing against compressed meshes decodes them, picking is rare
+		AllocationCounter::Allow allow;
 
-	vertexShader.SetViewTransform(g_camera.GetTransform());
+		g_pickPending = false;
+		// the click is in the window's pixels, whatever size is drawn
+		g_picked = Pick(projection, view, g_pickX, g_pickY, pFrame->GetStoredWidth(), pFrame->GetStoredHeight());
+	}
 
-	ObjectIterator iterator = g_sceneDriver->GetObjects();
+	const DamageTracker::Settings settings = { view, mode, cull, drawNormals, width, height };
 
-	while (iterator.HasMore())
+	ObjectIterator objects = g_sceneDriver->GetObjects();
+
+	const DamageTracker::Region region = g_damage.Update(settings, projection, objects.GetAll(), g_picked);
+
+	// the window may still need painting, e.g. after being covered, and the
+	// overlay still changes
+	if (region.IsEmpty())
 	{
-		geometry::Object * object = iterator.Next();
+		FrameCount(*g_frame);
+		g_frame->ShowAgain();
+		return ! paused;
+	}
 
-		const std::size_t passes = object->GetNumPasses();
+	const bool whole = g_damage.IsWhole(region);
+
+	Vector4 light { 0.0, 0.0, 0.0, 1.0 };
+	Vector3 lightViewSpace = (view * light).XYZ();
 
-		for (std::size_t pass = 0; pass < passes; ++pass)
+	rasta.SetLightPosition(lightViewSpace);
+
+	for (auto && shader : g_threadShaders)
+		shader.m_vertexShader->SetViewTransform(view);
+
+	// only what reaches into the region has to be drawn again
+	const Frustum frustum(CropToRegion(region, width, height) * projection.GetProjectionMatrix() * view);
+
+	std::chrono::high_resolution_clock::time_point cullStart = std::chrono::high_resolution_clock::now();
+
+	ObjectIterator iterator = g_sceneDriver->GetVisibleObjects(frustum);
+
+	g_cullMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::high_resolution_clock::now() - cullStart).count();
+
+	g_visibleObjects = iterator.GetAll().size();
+
+	RenderQueue queue;
+
+	g_drawnInstances = QueueDraws(iterator, frustum, projection, view, queue);
+
+	queue.Sort();
+
+	const std::size_t items = queue.GetNumItems();
+
+	ArenaVector<TriangleList> lists(items);
+	ArenaVector<ThreadScratch> scratch(jobs.GetNumThreads());
+
+	// only marks the tiles so it isn't worth a job, the rest of a partial
+	// frame is a copy of the last one
+	if (whole)
+	{
+		pFrame->Clear();
+	}
+	else
+	{
+		pFrame->KeepPrevious();
+		pFrame->Clear(region.m_left, region.m_top, region.m_right, region.m_bottom);
+	}
+
+	JobCounter prepared;
+
+	SetupDraws(queue, g_threadShaders, scratch, view, rasta, cull, drawNormals, lists, prepared);
+
+	JobCounter drawn;
+
+	// bands are whole rows of tiles so no two jobs draw into the same tile
+	const unsigned firstRow = region.m_top / FrameBuffer::kTileSize;
+	const unsigned tileRows = (region.m_bottom + FrameBuffer::kTileSize - 1) / FrameBuffer::kTileSize - firstRow;
+	const unsigned bands = std::max(1u, std::min(tileRows, jobs.GetNumThreads() * 4));
+
+	for (unsigned band = 0; band < bands; ++band)
+	{
+		const unsigned top = std::min(region.m_bottom, (firstRow + tileRows * band / bands) * FrameBuffer::kTileSize);
+		const unsigned bottom = std::min(region.m_bottom, (firstRow + tileRows * (band + 1) / bands) * FrameBuffer::kTileSize);
+
+		jobs.Run([&, top, bottom]()
 		{
-			ShadyObject * vshader = object->VertexShader(pass);
+			DrawBand(queue, lists, pFrame, mode, lightViewSpace, region.m_left, top, region.m_right, bottom);
+		}, &drawn, &prepared);
+	}
 
-			if (vshader)
-				vertexShader.SetShader(vshader);
+	jobs.Wait(drawn);
 
-			ShadyObject * fshader = object->FragmentShader(pass);
+	if (g_picked)
+		DrawBox(rasta, projection, view, g_picked->GetWorldBoundingBox());
 
-			if (fshader)
-				rasta.SetShader(fshader);
+	// the present thread shows this frame while the next one is drawn
+	FrameCount(*g_frame);
+	g_frame->Present();
 
-			bool reverseCull = object->ReverseCull(pass);
+	// part of a frame says nothing about how long a whole one takes
+	if (whole)
+	{
+		g_resolution.FrameFinished(std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - frameStart).count());
+	}
 
-			vertexShader.SetModelTransform(object->GetModelMatrix());
+#ifdef _DEBUG
+	// once the first frames have sized everything a frame shouldn't touch
+	// the heap, rare work that has to says so with AllocationCounter::Allow
+	if (++g_frames > kWarmUpFrames)
+		assert(AllocationCounter::GetCount() == allocations);
+#endif
 
-			const auto & triangles = object->GetTriangles();
-			const auto end = triangles.end();
+	return true;
+}
 
-			for (auto iter = triangles.begin(); iter != end; ++iter)
-			{
-				std::array<VertexShaderOutput,3> vertexShaded;
+// Draws the scene as it is now into a width x height image file a bucket at
+// a time, so a poster many times the size of the screen only ever has a
+// bucket for each thread in memory. Triangles are set up for the whole image
+// once and binned to the buckets they touch.
+void RenderPoster(const char * filename, unsigned width, unsigned height, PixelFormat format,
+	RenderMode mode, bool cull)
+{
+	// a poster is rare enough to allocate whatever it needs
+	AllocationCounter::Allow allow;
 
-				for (unsigned i = 0; i < 3; ++i)
-					vertexShaded[i] = vertexShader.Execute(iter->points[i], iter->normals[i]);
+	// no frame is being drawn so nothing in the arenas is still used
+	FrameArena::ResetAll();
 
-				geometry::Triangle projected = {
-					vertexShaded[0].m_projected.XYZ(),
-					vertexShaded[1].m_projected.XYZ(),
-					vertexShaded[2].m_projected.XYZ(),
-				};
+	JobSystem & jobs = JobSystem::Get();
 
-				if (cull && projected.IsAntiClockwise() == !reverseCull)
-					continue;
+	const unsigned threads = jobs.GetNumThreads();
 
-				rasta.DrawTriangle(vertexShaded);
+	const Projection projection(90.0f, 1.0f, 1000.0f, width, height);
+	const Matrix4 view = g_camera.GetTransform();
+	const Vector3 lightViewSpace = (view * Vector4(0.0, 0.0, 0.0, 1.0)).XYZ();
 
-				if (drawNormals)
-				{
-					for (unsigned i = 0; i < 3; ++i)
-					{
-						Vector3 start = iter->points[i];
-						Vector3 end = start + (iter->normals[i] * 5.0);
+	// the frame's own vertex shaders are tied to the window's projection
+	std::vector<ThreadShader> shaders(threads);
+
+	for (unsigned thread = 0; thread < threads; ++thread)
+	{
+		shaders[thread].m_vertexShader.reset(new VertexShader(projection,
+			ShaderCache::Get().GetThreadInstance(DefaultVertexShader(), thread)));
+
+		shaders[thread].m_bound = DefaultVertexShader();
+		shaders[thread].m_vertexShader->SetViewTransform(view);
+	}
+
+	const Frustum frustum(projection.GetProjectionMatrix() * view);
+
+	ObjectIterator iterator = g_sceneDriver->GetVisibleObjects(frustum);
+
+	RenderQueue queue;
+
+	QueueDraws(iterator, frustum, projection, view, queue);
 
-						VertexShaderOutput start_v = vertexShader.Execute(start);
-						VertexShaderOutput end_v = vertexShader.Execute(end);
+	queue.Sort();
 
-						rasta.DrawLine(
-							start_v.m_screen.x, start_v.m_screen.y,
-							end_v.m_screen.x, end_v.m_screen.y,
-							Colour::Red);
-					}
+	std::vector<std::unique_ptr<FrameBuffer>> buckets(threads);
 
+	for (auto && bucket : buckets)
+		bucket.reset(new FrameBuffer(width, height, kBucketSize, kBucketSize, format));
+
+	// setting up only needs the size of the whole image
+	Rasteriser setup(buckets[0].get(), mode, DefaultFragmentShader());
+
+	const std::size_t items = queue.GetNumItems();
+
+	ArenaVector<TriangleList> lists(items);
+	ArenaVector<ThreadScratch> scratch(threads);
+
+	JobCounter prepared;
+
+	SetupDraws(queue, shaders, scratch, view, setup, cull, false, lists, prepared);
+
+	jobs.Wait(prepared);
+
+	const unsigned bucketsAcross = (width + kBucketSize - 1) / kBucketSize;
+	const unsigned bucketsDown = (height + kBucketSize - 1) / kBucketSize;
+
+	std::vector<std::vector<BinnedTriangle>> bins(bucketsAcross * bucketsDown);
+
+	for (std::size_t n = 0; n < items; ++n)
+	{
+		const TriangleList & list = lists[n];
+
+		for (std::size_t triangle = 0; triangle < list.m_indices.size() / 3; ++triangle)
+		{
+			const Point & a = list.m_vertices[list.m_indices[triangle * 3]].m_screen;
+			const Point & b = list.m_vertices[list.m_indices[triangle * 3 + 1]].m_screen;
+			const Point & c = list.m_vertices[list.m_indices[triangle * 3 + 2]].m_screen;
+
+			// set up triangles are clipped to the image so the bounds are in it
+			const unsigned left = static_cast<unsigned>(std::max(0.0f, std::min(std::min(a.x, b.x), c.x))) / kBucketSize;
+			const unsigned top = static_cast<unsigned>(std::max(0.0f, std::min(std::min(a.y, b.y), c.y))) / kBucketSize;
+			const unsigned right = std::min(bucketsAcross - 1, static_cast<unsigned>(std::max(std::max(a.x, b.x), c.x)) / kBucketSize);
+			const unsigned bottom = std::min(bucketsDown - 1, static_cast<unsigned>(std::max(std::max(a.y, b.y), c.y)) / kBucketSize);
+
+			for (unsigned y = top; y <= bottom; ++y)
+			{
+				for (unsigned x = left; x <= right; ++x)
+				{
+					const BinnedTriangle binned = { static_cast<uint32_t>(n), static_cast<uint32_t>(triangle) };
+					bins[y * bucketsAcross + x].push_back(binned);
 				}
 			}
 		}
 	}
 
-	g_frame->CopyToWindow();
-	FrameCount(hWnd);
+	ImageWriter writer(filename, width, height, format);
+	std::mutex writing;
+
+	const unsigned rowBytes = kBucketSize * pixels::BytesPerPixel(format);
+
+	// a bucket's rows in the stored format for each thread
+	std::vector<std::vector<unsigned char>> rows(threads, std::vector<unsigned char>(kBucketSize * rowBytes));
+
+	JobCounter drawn;
+
+	for (unsigned bucket = 0; bucket < bins.size(); ++bucket)
+	{
+		jobs.Run([&, bucket]()
+		{
+			const unsigned thread = JobSystem::GetThreadIndex();
+
+			FrameBuffer & frame = *buckets[thread];
+			std::vector<unsigned char> & bytes = rows[thread];
+
+			const unsigned left = (bucket % bucketsAcross) * kBucketSize;
+			const unsigned top = (bucket / bucketsAcross) * kBucketSize;
+			const unsigned right = std::min(width, left + kBucketSize);
+			const unsigned bottom = std::min(height, top + kBucketSize);
+
+			frame.SetBucket(left, top);
+			frame.Clear();
+
+			DrawBucket(queue, lists, bins[bucket], &frame, mode, lightViewSpace, left, top, right, bottom);
+
+			for (unsigned y = top; y < bottom; ++y)
+				frame.ReadBucketRow(y - top, bytes.data() + (y - top) * rowBytes);
+
+			std::lock_guard<std::mutex> lock(writing);
+
+			for (unsigned y = top; y < bottom; ++y)
+				writer.Write(left, y, bytes.data() + (y - top) * rowBytes, right - left);
+		}, &drawn);
+	}
+
+	jobs.Wait(drawn);
+
+	// the poster's shaders are the same thread instances as the frame's so
+	// they're left with its projection, binding them again writes back the
+	// window's
+	for (unsigned thread = 0; thread < g_threadShaders.size(); ++thread)
+	{
+		ThreadShader & shader = g_threadShaders[thread];
+
+		shader.m_vertexShader->SetShader(ShaderCache::Get().GetThreadInstance(shader.m_bound, thread));
+	}
+
+	g_damage.Reset();
 }
 
 int WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
@@ -167,7 +957,11 @@ int WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
 		case WM_PAINT:
 			// TODO: put this somewhere else and use the default WM_PAINT handler
-			RenderLoop(hWnd, mode, cull, drawNormals, paused);
+			g_drawing = RenderLoop(hWnd, mode, cull, drawNormals, paused);
+
+			// the present thread shows the frame, there's nothing left for
+			// GDI to paint
+			ValidateRect(hWnd, NULL);
 			break;
 
 		case WM_LBUTTONDOWN:
@@ -180,6 +974,12 @@ int WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			g_inputHandler.RemoveMouseListener(&g_camera);
 			break;
 
+		case WM_RBUTTONUP:
+			g_pickPending = true;
+			g_pickX = LOWORD(lParam);
+			g_pickY = HIWORD(lParam);
+			break;
+
 		case WM_MOUSEMOVE:
 			g_inputHandler.DecodeMouseMove(lParam, wParam);
 			g_mx = LOWORD(lParam);
@@ -236,6 +1036,11 @@ int WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			else if (wParam == 'P')
 			{
 				g_sceneDriver->Next();
+				g_picked = nullptr;
+			}
+			else if (wParam == 'R')
+			{
+				RenderPoster("poster.bmp", kPosterWidth, kPosterHeight, PixelFormat::BGRA8, mode, cull);
 			}
 			break;
 
@@ -292,7 +1097,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCommand
 			DispatchMessage(&msg);
 		}
 
-		InvalidateRect(hwnd, NULL, false);
+		// frames are drawn one after another while the scene runs, once a
+		// paused one finds nothing has changed this waits in GetMessage
+		// for input
+		if (msg.message != WM_PAINT || g_drawing)
+			InvalidateRect(hwnd, NULL, false);
 	}
 	return 0;
 }
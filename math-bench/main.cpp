@@ -0,0 +1,328 @@
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include "AlignedAllocator.h"
+#include "BoundingVolumeHierarchy.h"
+#include "Frustum.h"
+#include "Geometry.h"
+#include "Matrix.h"
+#include "Projection.h"
+#include "SimdMath.h"
+#include "Vector.h"
+
+// Times the SIMD maths against plain loops, run the Release build with
+// nothing else going on
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// whatever the benchmark produces is added in here and printed so that
+	// the optimiser can't throw the work away
+	volatile Real g_sink;
+
+	std::mt19937 g_random(42);
+
+	Real RandomReal()
+	{
+		return std::uniform_real_distribution<Real>(-10.0f, 10.0f)(g_random);
+	}
+
+	Matrix4 RandomMatrix()
+	{
+		std::array<std::array<Real, 4>, 4> values;
+
+		for (auto && row : values)
+		{
+			for (auto && value : row)
+				value = RandomReal();
+		}
+
+		return values;
+	}
+
+	std::vector<Vector3> RandomVectors(std::size_t count)
+	{
+		std::vector<Vector3> vectors(count);
+
+		for (auto && v : vectors)
+			v = { RandomReal(), RandomReal(), RandomReal() };
+
+		return vectors;
+	}
+
+	// Just bounds, culling never looks at the mesh
+	class Box : public geometry::Object
+	{
+	public:
+		explicit Box(const Vector3 & position)
+		{
+			m_box = { { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f } };
+			m_sphere = { Vector3::Zero, std::sqrt(3.0f) };
+
+			SetModelMatrix(Matrix4::Translation(position));
+		}
+	};
+
+	// The operators as they were before SSE, element by element
+	Matrix4 ScalarMultiply(const Matrix4 & lhs, const Matrix4 & rhs)
+	{
+		std::array<std::array<Real, 4>, 4> values;
+
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			for (unsigned j = 0; j < 4; ++j)
+			{
+				values[i][j] = lhs(i, 0) * rhs(0, j) + lhs(i, 1) * rhs(1, j)
+					+ lhs(i, 2) * rhs(2, j) + lhs(i, 3) * rhs(3, j);
+			}
+		}
+
+		return values;
+	}
+
+	Vector4 ScalarMultiply(const Matrix4 & lhs, const Vector4 & rhs)
+	{
+		return {
+			lhs(0, 0) * rhs.x + lhs(0, 1) * rhs.y + lhs(0, 2) * rhs.z + lhs(0, 3) * rhs.w,
+			lhs(1, 0) * rhs.x + lhs(1, 1) * rhs.y + lhs(1, 2) * rhs.z + lhs(1, 3) * rhs.w,
+			lhs(2, 0) * rhs.x + lhs(2, 1) * rhs.y + lhs(2, 2) * rhs.z + lhs(2, 3) * rhs.w,
+			lhs(3, 0) * rhs.x + lhs(3, 1) * rhs.y + lhs(3, 2) * rhs.z + lhs(3, 3) * rhs.w,
+		};
+	}
+
+	// Best of a few runs, in nanoseconds per operation
+	template <typename Function>
+	double Time(std::size_t operations, Function && function)
+	{
+		double best = 1e30;
+
+		for (unsigned run = 0; run < 5; ++run)
+		{
+			const auto start = Clock::now();
+
+			function();
+
+			const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+
+			best = std::min(best, elapsed.count() / operations);
+		}
+
+		return best;
+	}
+
+	const char * Name(simd::InstructionSet instructionSet)
+	{
+		switch (instructionSet)
+		{
+		case simd::InstructionSet::AVX2: return "AVX2";
+		case simd::InstructionSet::SSE2: return "SSE2";
+		default: return "Scalar";
+		}
+	}
+
+	void BenchmarkOperators()
+	{
+		const std::size_t Count = 1 << 20;
+
+		const Matrix4 m = RandomMatrix();
+		const Matrix4 n = RandomMatrix();
+		const Vector4 v(RandomReal(), RandomReal(), RandomReal(), 1.0f);
+
+		// chained so that each result feeds the next and the loop can't be
+		// hoisted
+		const double scalarMM = Time(Count, [&]
+		{
+			Matrix4 r = m;
+
+			for (std::size_t i = 0; i < Count; ++i)
+				r = ScalarMultiply(r, n);
+
+			g_sink = r(0, 0);
+		});
+
+		const double simdMM = Time(Count, [&]
+		{
+			Matrix4 r = m;
+
+			for (std::size_t i = 0; i < Count; ++i)
+				r = r * n;
+
+			g_sink = r(0, 0);
+		});
+
+		const double scalarMV = Time(Count, [&]
+		{
+			Vector4 r = v;
+
+			for (std::size_t i = 0; i < Count; ++i)
+				r = ScalarMultiply(m, r);
+
+			g_sink = r.x;
+		});
+
+		const double simdMV = Time(Count, [&]
+		{
+			Vector4 r = v;
+
+			for (std::size_t i = 0; i < Count; ++i)
+				r = m * r;
+
+			g_sink = r.x;
+		});
+
+		std::printf("%-24s %10s %10s\n", "", "scalar", "SSE");
+		std::printf("%-24s %10.2f %10.2f ns\n", "Matrix4 * Matrix4", scalarMM, simdMM);
+		std::printf("%-24s %10.2f %10.2f ns\n", "Matrix4 * Vector4", scalarMV, simdMV);
+		std::printf("\n");
+	}
+
+	void BenchmarkKernels()
+	{
+		// about the size of a big model, larger than the caches so memory
+		// speed shows up too
+		const std::size_t Count = 1 << 20;
+
+		const Matrix4 m = RandomMatrix();
+		const std::vector<Vector3> input = RandomVectors(Count);
+
+		AlignedVector<Vector4> points(Count);
+		std::vector<Vector3> vectors(Count);
+
+		const simd::InstructionSet supported = simd::SupportedInstructionSet();
+
+		std::printf("%-24s", "");
+
+		for (int i = 0; i <= static_cast<int>(supported); ++i)
+			std::printf(" %10s", Name(static_cast<simd::InstructionSet>(i)));
+
+		std::printf("\n");
+
+		double results[4][3];
+
+		for (int i = 0; i <= static_cast<int>(supported); ++i)
+		{
+			simd::SetInstructionSet(static_cast<simd::InstructionSet>(i));
+
+			results[0][i] = Time(Count, [&]
+			{
+				simd::TransformPoints(m, input.data(), Count, points.data());
+				g_sink = points[Count - 1].x;
+			});
+
+			results[1][i] = Time(Count, [&]
+			{
+				simd::TransformVectors(m, input.data(), Count, vectors.data());
+				g_sink = vectors[Count - 1].x;
+			});
+
+			results[2][i] = Time(Count, [&]
+			{
+				vectors = input;
+				simd::NormaliseVectors(vectors.data(), Count);
+				g_sink = vectors[Count - 1].x;
+			});
+
+			results[3][i] = Time(Count, [&]
+			{
+				Vector3 min, max;
+				simd::ComputeBounds(input.data(), Count, min, max);
+				g_sink = min.x + max.x;
+			});
+		}
+
+		simd::SetInstructionSet(supported);
+
+		const char * names[] = { "TransformPoints", "TransformVectors", "NormaliseVectors", "ComputeBounds" };
+
+		for (unsigned k = 0; k < 4; ++k)
+		{
+			std::printf("%-24s", names[k]);
+
+			for (int i = 0; i <= static_cast<int>(supported); ++i)
+				std::printf(" %10.2f", results[k][i]);
+
+			std::printf(" ns\n");
+		}
+	}
+
+	void BenchmarkCulling()
+	{
+		// Objects are spread over the ground at the same density whatever
+		// their number, the far plane keeps more of them out of view as the
+		// count goes up. Testing every object grows with the count, the
+		// hierarchy should only grow with what it finds.
+		const Real Spacing = 10.0f;
+
+		const Projection projection(90.0f, 1.0f, 1000.0f, 1280, 720);
+		const Frustum frustum(projection.GetProjectionMatrix());
+
+		std::printf("\n%-24s %10s %10s %10s\n", "", "visible", "all", "BVH");
+
+		for (std::size_t count : { 1000, 10000, 100000 })
+		{
+			const Real half = std::sqrt(static_cast<Real>(count)) * Spacing * 0.5f;
+
+			std::uniform_real_distribution<Real> across(-half, half);
+			std::uniform_real_distribution<Real> height(-20.0f, 20.0f);
+
+			std::vector<std::unique_ptr<Box>> boxes;
+			std::vector<geometry::Object*> objects;
+
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				boxes.emplace_back(new Box({ across(g_random), height(g_random), across(g_random) }));
+				objects.push_back(boxes.back().get());
+			}
+
+			BoundingVolumeHierarchy hierarchy;
+			hierarchy.Build(objects);
+
+			std::vector<geometry::Object*> visible;
+			visible.reserve(count);
+
+			// the same tests QueueDraws makes of each instance
+			const double all = Time(1, [&]
+			{
+				visible.clear();
+
+				for (geometry::Object * object : objects)
+				{
+					if (frustum.Intersects(object->GetWorldBoundingSphere()) &&
+						frustum.Intersects(object->GetWorldBoundingBox()))
+						visible.push_back(object);
+				}
+
+				g_sink = static_cast<Real>(visible.size());
+			});
+
+			const std::size_t found = visible.size();
+
+			const double tree = Time(1, [&]
+			{
+				visible.clear();
+				hierarchy.Cull(frustum, visible);
+
+				g_sink = static_cast<Real>(visible.size());
+			});
+
+			char name[32];
+			std::snprintf(name, sizeof(name), "Cull %u objects", static_cast<unsigned>(count));
+
+			std::printf("%-24s %10u %10.1f %10.1f us\n", name, static_cast<unsigned>(found), all / 1000.0, tree / 1000.0);
+		}
+	}
+}
+
+int main()
+{
+	BenchmarkOperators();
+	BenchmarkKernels();
+	BenchmarkCulling();
+
+	return 0;
+}
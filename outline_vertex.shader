@@ -8,7 +8,7 @@ export void main()
 	g_projected_position[1] /= g_projected_position[3];
 	g_projected_position[2] /= g_projected_position[3];
 
-	g_world_normal = normalize(g_view * g_model * g_normal);
+	g_world_normal = normalize(g_normal_matrix * g_normal);
 
 	g_world_position = (g_view * g_model * position);
 
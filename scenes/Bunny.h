@@ -4,7 +4,7 @@
 #include "Matrix.h"
 #include "Scene.h"
 
-#include "ObjReader.h"
+#include "MeshCache.h"
 
 namespace scene
 {
@@ -15,11 +15,13 @@ class Bunny
 public:
 	Bunny()
 	{
-		ObjReader reader;
+		m_bunny = MeshCache::Load("models\\bunny.wfobj");
 
-		if (reader.Read("models\\bunny.wfobj"))
+		if (m_bunny)
 		{
-			m_bunny = reader.GetModel();
+			// a scanned model, the vertex stage is bound by memory not maths
+			m_bunny->CompressVertices();
+
 			m_bunny->SetModelMatrix(Matrix4::Translation({ 0.0, -5.0, -50.0 }) * Matrix4::Scale({ 80.0, 80.0, 80.0 }));
 		}
 	}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+#include "Colour.h"
+#include "AlignedAllocator.h"
+#include "Geometry.h"
+#include "JobSystem.h"
+#include "Matrix.h"
+#include "Scene.h"
+
+#include "MeshCache.h"
+
+namespace scene
+{
+
+// Thousands of bunnies drawn as instances of a single mesh, each one turning
+// at its own speed and tinted by where it stands in the crowd
+class BunnyCrowd
+	: public IScene
+{
+public:
+	BunnyCrowd()
+	{
+		m_bunny = MeshCache::Load("models\\bunny.wfobj");
+
+		if (! m_bunny)
+			return;
+
+		m_bunny->CompressVertices();
+
+		for (unsigned z = 0; z < kSide; ++z)
+		{
+			for (unsigned x = 0; x < kSide; ++x)
+			{
+				const Real u = static_cast<Real>(x) / (kSide - 1);
+				const Real v = static_cast<Real>(z) / (kSide - 1);
+
+				const Colour colour(u, 0.4f + 0.6f * v, 1.0f - u);
+
+				// the object starts with one instance so the first only needs
+				// its colour
+				if (x == 0 && z == 0)
+					m_bunny->SetInstanceColour(0, colour);
+				else
+					m_bunny->AddInstance(Matrix4::Identity, colour);
+			}
+		}
+
+		Place(0.0);
+	}
+
+	void Update(long long ms)
+	{
+		m_time += static_cast<Real>(ms) * 0.001;
+
+		if (m_bunny)
+			Place(m_time);
+	}
+
+	ObjectIterator GetObjects()
+	{
+		if (m_bunny)
+			return ObjectIterator({ m_bunny.get() });
+
+		return ObjectIterator({});
+	}
+
+private:
+	void Place(Real time)
+	{
+		m_models.resize(kSide * kSide);
+
+		// the matrices are independent, setting them on the object is kept
+		// on this thread because it also marks the merged bounds as stale
+		JobSystem::Get().ParallelFor(m_models.size(), kSide, [this, time](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t index = begin; index < end; ++index)
+			{
+				const unsigned x = index % kSide;
+				const unsigned z = index / kSide;
+
+				const Real degrees = std::fmod(time * 30.0f * (1 + index % 5) + index * 17.0f, 360.0f);
+
+				m_models[index] =
+					Matrix4::Translation({
+						(static_cast<Real>(x) - kSide / 2.0f) * kSpacing,
+						-5.0,
+						-10.0f - static_cast<Real>(z) * kSpacing }) *
+					Matrix4::RotationAboutY(Units::Degrees, degrees) *
+					Matrix4::Scale({ kScale, kScale, kScale });
+			}
+		});
+
+		for (std::size_t index = 0; index < m_models.size(); ++index)
+			m_bunny->SetInstanceModelMatrix(index, m_models[index]);
+	}
+
+private:
+	static const unsigned kSide = 40;
+	static constexpr Real kSpacing = 5.0;
+	static constexpr Real kScale = 20.0;
+
+	Real m_time = 0.0;
+	std::unique_ptr<geometry::Object> m_bunny;
+	AlignedVector<Matrix4> m_models;
+};
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "Geometry.h"
+#include "Matrix.h"
+#include "Scene.h"
+
+namespace scene
+{
+
+// A large grid of small cubes, most of which are off screen at any time. It
+// is here to measure how culling scales with the number of objects.
+class CubeField
+	: public IScene
+{
+public:
+	CubeField()
+		: m_cubes(kSide * kSide, geometry::Cube(2.0))
+	{
+		m_objects.reserve(m_cubes.size());
+
+		for (auto && cube : m_cubes)
+			m_objects.push_back(&cube);
+
+		Place(0.0, true);
+	}
+
+	void Update(long long ms)
+	{
+		m_time += static_cast<Real>(ms) * 0.001;
+
+		Place(m_time, false);
+	}
+
+	ObjectIterator GetObjects()
+	{
+		return ObjectIterator(m_objects);
+	}
+
+private:
+	// only some of the cubes move so the tree gets refitted without every
+	// object having changed
+	void Place(Real time, bool all)
+	{
+		for (unsigned z = 0; z < kSide; ++z)
+		{
+			for (unsigned x = 0; x < kSide; ++x)
+			{
+				const unsigned index = z * kSide + x;
+				const bool moving = (index % kMovingEvery == 0);
+
+				if (!moving && !all)
+					continue;
+
+				Real y = -10.0;
+
+				if (moving)
+					y += 5.0 * std::sin(time * 2.0 + index);
+
+				m_cubes[index].SetModelMatrix(Matrix4::Translation({
+					(static_cast<Real>(x) - kSide / 2.0f) * kSpacing,
+					y,
+					-10.0f - static_cast<Real>(z) * kSpacing }));
+			}
+		}
+	}
+
+private:
+	static const unsigned kSide = 100;
+	static const unsigned kMovingEvery = 16;
+	static constexpr Real kSpacing = 6.0;
+
+	Real m_time = 0.0;
+	std::vector<geometry::Cube> m_cubes;
+	std::vector<geometry::Object*> m_objects;
+};
+
+}
@@ -4,7 +4,7 @@
 #include "Matrix.h"
 #include "Scene.h"
 
-#include "ObjReader.h"
+#include "MeshCache.h"
 
 namespace scene
 {
@@ -14,11 +14,10 @@ namespace scene
 	public:
 		Teapot()
 		{
-			ObjReader reader;
+			m_teapot = MeshCache::Load("models\\teapot.wfobj");
 
-			if (reader.Read("models\\teapot.wfobj"))
+			if (m_teapot)
 			{
-				m_teapot = reader.GetModel();
 				m_teapot->SetModelMatrix(Matrix4::Translation({ 0.0, -5.0, -30.0 }) * Matrix4::Scale({ 10.0, 10.0, 10.0 }));
 
 				// Pass 1 backface rendering for outlines
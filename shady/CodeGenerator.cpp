@@ -282,6 +282,11 @@ void CodeGenerator::Generate(ShadyObject * object, SyntaxNode * root)
 	object->NoteGlobals(m_symbolTable);
 	object->WriteConstants(m_constantFloats, m_constantVectors);
 	object->WriteFunctions(m_functions);
+
+	if (! m_context.GetStreams().empty())
+		object->WriteBatchEntry(m_context.GetStreams());
+
+	object->WriteStack();
 }
 
 void CodeGenerator::InitialLayout()
@@ -306,7 +311,8 @@ void CodeGenerator::InitialLayout()
 			assert(contextVariable);
 
 			// Put context out variables in memory as it's likely they're only being used once to write to
-			if (contextVariable->m_type == ContextVariable::Output)
+			// Streamed variables are copied to and from memory by the batch loop
+			if (contextVariable->m_type == ContextVariable::Output || m_context.IsStreamed(global->GetName()))
 			{
 				m_layout.PlaceGlobalInMemory(global);
 				continue;
@@ -36,6 +36,15 @@ const ProgramContext & ProgramContext::VertexShaderContext()
 			{ "g_world_position", BuiltinTypeType::Vec4, ContextVariable::Output },
 			{ "g_world_normal", BuiltinTypeType::Vec4, ContextVariable::Output },
 		},
+		{
+			// positions and normals are read as xyz, w is set once per batch
+			{ "g_position", ContextVariable::Input, 12 },
+			{ "g_normal", ContextVariable::Input, 12 },
+
+			{ "g_projected_position", ContextVariable::Output, 16 },
+			{ "g_world_position", ContextVariable::Output, 12 },
+			{ "g_world_normal", ContextVariable::Output, 12 },
+		},
 		functions
 	};
 
@@ -53,6 +62,7 @@ const ProgramContext & ProgramContext::FragmentShaderContext()
 
 			{ "g_colour", BuiltinTypeType::Vec4, ContextVariable::Output },
 		},
+		{},
 		functions
 	};
 
@@ -108,3 +118,9 @@ const ContextVariable * ProgramContext::GetVariable(const std::string & name) co
 
 	return &*iter;
 }
+
+bool ProgramContext::IsStreamed(const std::string & name) const
+{
+	return std::any_of(m_streams.begin(), m_streams.end(),
+		[&](const ContextStream & s){ return s.m_name == name; });
+}
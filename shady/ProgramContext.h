@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include "BuiltinTypes.h"
@@ -21,6 +22,16 @@ struct ContextVariable
 	Type m_type;
 };
 
+// A context variable that can be read from (or written to) an array when the
+// program is run over a batch of elements. Only the first m_size bytes of the
+// variable are copied, the rest are left as they were set before the batch.
+struct ContextStream
+{
+	std::string m_name;
+	ContextVariable::Type m_type;
+	uint32_t m_size;
+};
+
 struct ContextFunction
 {
 	std::string m_name;
@@ -39,14 +50,24 @@ public:
 
 	const ContextVariable * GetVariable(const std::string & name) const;
 
+	const std::vector<ContextStream> & GetStreams() const
+	{
+		return m_streams;
+	}
+
+	bool IsStreamed(const std::string & name) const;
+
 private:
 	template<std::size_t N>
-	ProgramContext(std::vector<ContextVariable> && variables, const std::array<ContextFunction, N> & functions)
+	ProgramContext(std::vector<ContextVariable> && variables, std::vector<ContextStream> && streams,
+		const std::array<ContextFunction, N> & functions)
 		: m_variables(std::move(variables))
+		, m_streams(std::move(streams))
 		, m_functions(functions.begin(), functions.end())
 	{ }
 
 private:
 	std::vector<ContextVariable> m_variables;
+	std::vector<ContextStream> m_streams;
 	std::vector<ContextFunction> m_functions;
 };
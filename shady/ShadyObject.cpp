@@ -36,6 +36,32 @@ void ShadyObject::Execute()
 	}
 }
 
+void ShadyObject::ExecuteBatch(uint32_t count, const BatchStream * streams)
+{
+	assert(m_batchEntryPoint);
+
+	if (count == 0)
+		return;
+
+	m_batchParameters[0] = count;
+
+	for (uint32_t i = 0; i < m_batchStreams; ++i)
+	{
+		m_batchParameters[1 + i * 2] = reinterpret_cast<uint32_t>(streams[i].m_data);
+		m_batchParameters[2 + i * 2] = streams[i].m_stride;
+	}
+
+	void *fp = m_batchEntryPoint;
+	uint32_t esi_store;
+
+	__asm
+	{
+		mov [esi_store], esi
+		call [fp]
+		mov esi, [esi_store]
+	}
+}
+
 void ShadyObject::ReserveGlobalSize(uint32_t size)
 {
 	m_cursor = size;
@@ -129,28 +155,150 @@ void ShadyObject::WriteFunctions(const std::unordered_map<std::string, FunctionC
 		m_cursor += static_cast<uint32_t>(function.second.m_bytes.size());
 	}
 
+	auto iter = m_exports.find("main");
+
+	if (iter == m_exports.end())
+		throw std::runtime_error("shader has no main() export");
+
+	m_entryPoint = iter->second;
+}
+
+void ShadyObject::WriteBatchEntry(const std::vector<ContextStream> & streams)
+{
+	assert(m_entryPoint);
+
+	// Parameter block is the element count followed by a (pointer, stride)
+	// pair for each stream. The loop keeps its state there because main() is
+	// free to use every register apart from esp, ebp and esi.
+
+	if (m_cursor % 4 != 0)
+		m_cursor += (4 - (m_cursor % 4));
+
+	m_batchParameters = reinterpret_cast<uint32_t*>(ObjectCursor());
+	m_batchStreams = static_cast<uint32_t>(streams.size());
+	m_cursor += 4 + m_batchStreams * 8;
+
+	assert(4 + m_batchStreams * 8 < 128);
+
+	if (m_cursor % 64 != 0)
+		m_cursor += (64 - (m_cursor % 64));
+
+	const uint32_t start = reinterpret_cast<uint32_t>(ObjectCursor());
+	std::vector<uint8_t> code;
+
+	auto Bytes = [&code](std::initializer_list<uint8_t> bytes)
+	{
+		code.insert(code.end(), bytes);
+	};
+
+	auto Imm32 = [&code](uint32_t value)
 	{
-		// Make sure the stack isn't too close to the generated code otherwise it can
-		// cause slowdowns due to invalidation of CPU instruction cache when writing
-		// to stack.
-		// TODO : make this a reasonable number that is checked
-		m_cursor += 0x100;
+		uint8_t * bytes = (uint8_t*)&value;
+		code.insert(code.end(), bytes, bytes + 4);
+	};
+
+	// push ebp
+	Bytes({ 0x55 });
+
+	// mov ebp, imm32
+	Bytes({ 0xBD });
+	Imm32(reinterpret_cast<uint32_t>(m_batchParameters));
+
+	const uint32_t loop = static_cast<uint32_t>(code.size());
+
+	auto CopyStream = [&](const ContextStream & stream, uint8_t pointer, bool input)
+	{
+		auto global = m_globals.find(stream.m_name);
+
+		if (global == m_globals.end())
+			throw std::runtime_error("couldn't find global '" + stream.m_name + "'");
 
-		// Update trampoline to set stack ptr
-		void * stackStart = ObjectCursor();
-		std::size_t space;
+		assert(global->second.first == Memory);
+		assert(stream.m_size % 4 == 0 && stream.m_size < 128);
 
-		std::align(16, 0x1000, stackStart, space);
+		const uint32_t address = reinterpret_cast<uint32_t>((void*)m_object) + global->second.second;
 
-		std::memcpy(m_stackPointerSet, &stackStart, sizeof(void*));
+		// mov eax, [ebp + pointer]
+		Bytes({ 0x8B, 0x45, pointer });
+
+		for (uint8_t offset = 0; offset < stream.m_size; offset += 4)
+		{
+			if (input)
+			{
+				// mov ecx, [eax + offset]
+				Bytes({ 0x8B, 0x48, offset });
+
+				// mov [address + offset], ecx
+				Bytes({ 0x89, 0x0D });
+				Imm32(address + offset);
+			}
+			else
+			{
+				// mov ecx, [address + offset]
+				Bytes({ 0x8B, 0x0D });
+				Imm32(address + offset);
+
+				// mov [eax + offset], ecx
+				Bytes({ 0x89, 0x48, offset });
+			}
+		}
+
+		// add eax, [ebp + stride]
+		Bytes({ 0x03, 0x45, static_cast<uint8_t>(pointer + 4) });
+
+		// mov [ebp + pointer], eax
+		Bytes({ 0x89, 0x45, pointer });
+	};
+
+	for (uint32_t i = 0; i < m_batchStreams; ++i)
+	{
+		if (streams[i].m_type == ContextVariable::Input)
+			CopyStream(streams[i], static_cast<uint8_t>(4 + i * 8), true);
 	}
 
-	auto iter = m_exports.find("main");
+	// call main
+	Bytes({ 0xE8 });
+	Imm32(reinterpret_cast<uint32_t>(m_entryPoint) - (start + static_cast<uint32_t>(code.size()) + 4));
 
-	if (iter == m_exports.end())
-		throw std::runtime_error("shader has no main() export");
+	for (uint32_t i = 0; i < m_batchStreams; ++i)
+	{
+		if (streams[i].m_type == ContextVariable::Output)
+			CopyStream(streams[i], static_cast<uint8_t>(4 + i * 8), false);
+	}
 
-	m_entryPoint = iter->second;
+	// dec dword ptr [ebp]
+	Bytes({ 0xFF, 0x4D, 0x00 });
+
+	// jnz loop
+	Bytes({ 0x0F, 0x85 });
+	Imm32(loop - (static_cast<uint32_t>(code.size()) + 4));
+
+	// pop ebp
+	// ret
+	Bytes({ 0x5D, 0xC3 });
+
+	m_batchEntryPoint = ObjectCursor();
+
+	std::memcpy(ObjectCursor(), code.data(), code.size());
+
+	m_cursor += static_cast<uint32_t>(code.size());
+}
+
+void ShadyObject::WriteStack()
+{
+	// Make sure the stack isn't too close to the generated code otherwise it can
+	// cause slowdowns due to invalidation of CPU instruction cache when writing
+	// to stack.
+	// TODO : make this a reasonable number that is checked
+	m_cursor += 0x100;
+
+	// Update trampoline to set stack ptr
+	void * stackStart = ObjectCursor();
+	std::size_t space;
+
+	std::align(16, 0x1000, stackStart, space);
+
+	std::memcpy(m_stackPointerSet, &stackStart, sizeof(void*));
 }
 
 void * ShadyObject::ObjectCursor() const
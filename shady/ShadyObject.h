@@ -36,6 +36,16 @@ public:
 
 	void Execute();
 
+	struct BatchStream
+	{
+		void * m_data;
+		uint32_t m_stride;
+	};
+
+	// Runs main() once per element. Streams are given in the order the program
+	// context declares them and each advances by its stride after every element.
+	void ExecuteBatch(uint32_t count, const BatchStream * streams);
+
 	void ReserveGlobalSize(uint32_t size);
 
 	void WriteConstants(
@@ -46,6 +56,10 @@ public:
 
 	void WriteFunctions(const std::unordered_map<std::string, FunctionCode> & functions);
 
+	void WriteBatchEntry(const std::vector<ContextStream> & streams);
+
+	void WriteStack();
+
 	class GlobalWriter
 	{
 	public:
@@ -122,12 +136,14 @@ public:
 		void * m_source;
 	};
 
-	GlobalWriter GetGlobalLocation(const std::string & name)
+	// Names are looked up without making a std::string so that binding a
+	// shader doesn't allocate
+	GlobalWriter GetGlobalLocation(const char * name)
 	{
 		auto iter = m_globals.find(name);
 
 		if (iter == m_globals.end())
-			throw std::runtime_error("couldn't find global '" + name + "'");
+			throw std::runtime_error(std::string("couldn't find global '") + name + "'");
 
 		char * pointer = reinterpret_cast<char*>((void*)m_object);
 		pointer += iter->second.second;
@@ -135,12 +151,12 @@ public:
 		return GlobalWriter(pointer, iter->second.first != Memory);
 	}
 
-	GlobalReader GetGlobalReader(const std::string & name)
+	GlobalReader GetGlobalReader(const char * name)
 	{
 		auto iter = m_globals.find(name);
 
 		if (iter == m_globals.end())
-			throw std::runtime_error("couldn't find global '" + name + "'");
+			throw std::runtime_error(std::string("couldn't find global '") + name + "'");
 
 		char * pointer = reinterpret_cast<char*>((void*)m_object);
 		pointer += iter->second.second;
@@ -165,8 +181,11 @@ private:
 	};
 
 	std::unordered_map<std::string, void*> m_exports;
-	std::unordered_map<std::string, std::pair<GlobalType,uint32_t>> m_globals;
+	std::map<std::string, std::pair<GlobalType,uint32_t>, std::less<>> m_globals;
 	void * m_entryPoint = nullptr;
+	void * m_batchEntryPoint = nullptr;
+	uint32_t * m_batchParameters = nullptr;
+	uint32_t m_batchStreams = 0;
 	void * m_globalTrampoline = nullptr;
 	void * m_stackPointerSet = nullptr;
 	ScopedAlloc m_object;
@@ -8,7 +8,7 @@ export void main()
 
 	g_world_position = g_view * g_model * g_position;
 
-	g_world_normal = normalize(g_view * g_model * g_normal);
+	g_world_normal = normalize(g_normal_matrix * g_normal);
 
 	return;
 }
\ No newline at end of file